@@ -0,0 +1,438 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <gsl/gsl_errno.h>
+#include <gsl/gsl_math.h>
+#include <gsl/gsl_multiroots.h>
+
+#include "kernels.h"
+#include "vector.h"
+#include "solver.h"
+#include "telemetry.h"
+
+/*
+ * Least time of a benchmark in seconds. Operations are repeated, doubling
+ * the repetition count, until they take that long
+ */
+#define BENCH_MIN_TIME 0.2
+
+/*
+ * Output formats
+ */
+#define FORMAT_JSON "json"
+#define FORMAT_CSV "csv"
+
+typedef void (*bench_func)(void *);     /* type of benchmarked operation */
+
+/*
+ * Holds GSL representations of a kernel and the benchmarked region of its
+ * (k, d) plane
+ */
+struct kernel_funcs{
+    char type;
+    FFunc f;
+    DFunc df;
+    FDFunc fdf;
+    double k_first;             /* excess kurtosis range */
+    double k_last;
+    double d_first;             /* standard deviation range */
+    double d_last;
+};
+
+/*
+ * Holds info about a benchmark run
+ */
+struct bench_result{
+    const char *name;           /* benchmark name */
+    char kern_type;             /* kernel type or '-' */
+    int count;                  /* space node count or 0 */
+    long reps;                  /* count of timed operations */
+    double seconds;             /* total time of the operations */
+};
+
+/*
+ * Holds the state of a benchmarked operation
+ */
+struct bench_state{
+    const struct kernel *kern;  /* kernel */
+    const struct kernel_funcs *funcs; /* its GSL representation */
+    double a;                   /* kernel parameters */
+    double b;
+    struct params params;       /* kernel calculation params */
+    gsl_vector *x;              /* kernel parameters vector */
+    gsl_vector *f;              /* residuals */
+    gsl_matrix *J;              /* jacobian */
+    struct vector_func func;    /* integrated function */
+    struct problem_info *p;     /* swept problem */
+    double sink;                /* keeps results alive */
+};
+
+
+
+static const struct kernel_funcs all_funcs[] = {
+    { KURTIC, kurtic_f, kurtic_df, kurtic_fdf, 0.0, 4.0, 0.2, 1.1 },
+    { RGARDEN, rgarden_f, rgarden_df, rgarden_fdf, 0.0, 4.0, 0.2, 1.1 },
+    { POLYEXP, polyexp_f, polyexp_df, polyexp_fdf, -1.0, -0.2, 0.2, 0.5 }
+};
+
+static const int space_counts[] = { 1001, 10001, 100001 };
+
+#define KERNEL_COUNT (int)(sizeof(all_funcs) / sizeof(all_funcs[0]))
+#define SPACE_COUNT (int)(sizeof(space_counts) / sizeof(space_counts[0]))
+
+
+
+
+
+/*======================================================================*/
+/*                                  RUNNER                              */
+/*======================================================================*/
+/*
+ * Times the operation until it takes BENCH_MIN_TIME
+ */
+void run_bench(bench_func func, void *state, struct bench_result *r)
+{
+    double start;
+    long reps = 1;
+    long i;
+
+    for(;;){
+        start = get_wall_time();
+        for(i = 0; i < reps; i++){
+            func(state);
+        }
+        r->seconds = get_wall_time() - start;
+        r->reps = reps;
+
+        if(r->seconds >= BENCH_MIN_TIME){
+            break;
+        }
+
+        reps *= 2;
+    }
+}
+
+
+
+/*
+ * Writes the benchmark result in the given format
+ */
+void print_result(FILE *out, const char *format,
+    const struct bench_result *r, int first)
+{
+    double ns = 1e9 * r->seconds / r->reps;
+
+    if(strcmp(format, FORMAT_CSV) == 0){
+        fprintf(out, "%s,%c,%d,%ld,%.6lf,%.1lf\n", r->name, r->kern_type,
+            r->count, r->reps, r->seconds, ns);
+        return;
+    }
+
+    fprintf(
+        out,
+        "%s    {\"name\": \"%s\", \"kernel\": \"%c\", \"count\": %d, "
+        "\"reps\": %ld, \"seconds\": %.6lf, \"ns_per_op\": %.1lf}",
+        first ? "" : ",\n",
+        r->name,
+        r->kern_type,
+        r->count,
+        r->reps,
+        r->seconds,
+        ns
+    );
+}
+
+
+
+
+
+/*======================================================================*/
+/*                                PROBLEMS                              */
+/*======================================================================*/
+/*
+ * Makes the problem of the kernel on the grid over its benchmarked
+ * region. Sizes of 1 make the single point in the middle of the region
+ */
+struct problem_info *make_problem(const struct kernel_funcs *funcs,
+    int k_count, int d_count, int space_count)
+{
+    struct problem_info *p = malloc(sizeof(struct problem_info));
+    double k_span = funcs->k_last - funcs->k_first;
+    double d_span = funcs->d_last - funcs->d_first;
+
+    p->k_grid.origin = funcs->k_first + (k_count > 1 ? 0.0 : 0.5 * k_span);
+    p->k_grid.count = k_count;
+    p->k_grid.step = k_count > 1 ? k_span / (k_count - 1) : 0.0;
+
+    p->row_first = 0;
+    p->row_stride = 1;
+
+    p->d_grid.origin = funcs->d_first + (d_count > 1 ? 0.0 : 0.5 * d_span);
+    p->d_grid.count = d_count;
+    p->d_grid.step = d_count > 1 ? d_span / (d_count - 1) : 0.0;
+
+    p->space_grid.count = space_count;
+    p->space_dim = 1;
+    p->iter_count = 100;
+    p->eps = 1e-6;
+    p->thread_count = 1;
+    p->continuation = 0;
+
+    p->kern_type = funcs->type;
+    p->accuracy = VM_FULL;
+    p->quad = quad_alloc(QUAD_SIMPSON, space_count, 0.0);
+    p->table = NULL;
+    p->polish = 0;
+    p->telemetry = NULL;
+
+    p->f = funcs->f;
+    p->df = funcs->df;
+    p->fdf = funcs->fdf;
+
+    return p;
+}
+
+
+
+void free_problem(struct problem_info *p)
+{
+    quad_free(p->quad);
+    free(p);
+}
+
+
+
+/*
+ * Prepares the state of kernel benchmarks at the solution of the middle
+ * point of the region, so kernels are evaluated at representative
+ * parameters
+ */
+void init_kernel_state(struct bench_state *s,
+    const struct kernel_funcs *funcs)
+{
+    struct problem_info *p = make_problem(funcs, 1, 1, 10001);
+    struct result res = solve(p);
+
+    s->kern = get_kernel(funcs->type);
+    s->funcs = funcs;
+    s->a = res.a.storage[0];
+    s->b = res.b.storage[0];
+
+    s->x = gsl_vector_alloc(2);
+    s->f = gsl_vector_alloc(2);
+    s->J = gsl_matrix_alloc(2, 2);
+    gsl_vector_set(s->x, 0, s->a);
+    gsl_vector_set(s->x, 1, s->b);
+
+    s->params.k = p->k_grid.origin;
+    s->params.d = p->d_grid.origin * p->d_grid.origin;
+    s->params.space_dim = 1;
+    s->params.accuracy = VM_FULL;
+    s->params.quad = NULL;
+    s->params.prefetch = 0;
+    clear_cache(&(s->params));
+
+    free(res.a.storage);
+    free(res.b.storage);
+    free_problem(p);
+}
+
+
+
+void free_kernel_state(struct bench_state *s)
+{
+    gsl_vector_free(s->x);
+    gsl_vector_free(s->f);
+    gsl_matrix_free(s->J);
+}
+
+
+
+
+
+/*======================================================================*/
+/*                               OPERATIONS                             */
+/*======================================================================*/
+void bench_origin(void *state)
+{
+    struct bench_state *s = (struct bench_state *)state;
+
+    s->sink += get_origin(s->kern, s->a, s->b);
+}
+
+
+
+void bench_integral(void *state)
+{
+    struct bench_state *s = (struct bench_state *)state;
+
+    s->sink += get_integral(&(s->func));
+}
+
+
+
+void bench_norm(void *state)
+{
+    struct bench_state *s = (struct bench_state *)state;
+
+    s->sink += get_norm(&(s->func));
+}
+
+
+
+/*
+ * The cache is cleared, so every call integrates the kernel
+ */
+void bench_f(void *state)
+{
+    struct bench_state *s = (struct bench_state *)state;
+
+    clear_cache(&(s->params));
+    s->funcs->f(s->x, &(s->params), s->f);
+    s->sink += gsl_vector_get(s->f, 0);
+}
+
+
+
+void bench_fdf(void *state)
+{
+    struct bench_state *s = (struct bench_state *)state;
+
+    clear_cache(&(s->params));
+    s->funcs->fdf(s->x, &(s->params), s->f, s->J);
+    s->sink += gsl_matrix_get(s->J, 0, 0);
+}
+
+
+
+void bench_solve(void *state)
+{
+    struct bench_state *s = (struct bench_state *)state;
+    struct result res = solve(s->p);
+
+    s->sink += res.a.storage[0];
+    free(res.a.storage);
+    free(res.b.storage);
+}
+
+
+
+
+
+/*======================================================================*/
+/*                                   MAIN                               */
+/*======================================================================*/
+/*
+ * Runs all benchmarks. Arguments: output format (json or csv) and output
+ * file, the standard output by default
+ */
+int main(int argc, const char **argv)
+{
+    const char *format = argc > 1 ? argv[1] : FORMAT_JSON;
+    FILE *out = stdout;
+    struct bench_state s;
+    struct bench_result r;
+    struct quadrature *quad;
+    double x;
+    int first = 1;
+    int i;
+    int j;
+    int n;
+
+    if(strcmp(format, FORMAT_JSON) != 0 && strcmp(format, FORMAT_CSV) != 0){
+        fprintf(stderr, "### Invalid format!\n");
+        return 1;
+    }
+
+    if(argc > 2){
+        out = fopen(argv[2], "w");
+        if(out == NULL){
+            fprintf(stderr, "### Cannot open output!\n");
+            return 1;
+        }
+    }
+
+    if(strcmp(format, FORMAT_CSV) == 0){
+        fprintf(out, "name,kernel,count,reps,seconds,ns_per_op\n");
+    }else{
+        fprintf(out, "{\n  \"benchmarks\": [\n");
+    }
+
+    memset(&s, 0, sizeof(s));
+
+    /* integration of a gaussian */
+    for(j = 0; j < SPACE_COUNT; j++){
+        s.func.grid.count = space_counts[j];
+        s.func.grid.origin = -8.0;
+        s.func.grid.step = 16.0 / (space_counts[j] - 1);
+        s.func.storage = malloc(sizeof(double) * space_counts[j]);
+        for(n = 0; n < space_counts[j]; n++){
+            x = s.func.grid.origin + n * s.func.grid.step;
+            s.func.storage[n] = exp(-0.5 * x * x);
+        }
+
+        r.kern_type = '-';
+        r.count = space_counts[j];
+        r.name = "get_integral";
+        run_bench(&bench_integral, &s, &r);
+        print_result(out, format, &r, first);
+        first = 0;
+
+        r.name = "get_norm";
+        run_bench(&bench_norm, &s, &r);
+        print_result(out, format, &r, first);
+
+        free(s.func.storage);
+    }
+
+    for(i = 0; i < KERNEL_COUNT; i++){
+        init_kernel_state(&s, all_funcs + i);
+
+        r.kern_type = all_funcs[i].type;
+        r.count = 0;
+        r.name = "get_origin";
+        run_bench(&bench_origin, &s, &r);
+        print_result(out, format, &r, first);
+
+        for(j = 0; j < SPACE_COUNT; j++){
+            quad = quad_alloc(QUAD_SIMPSON, space_counts[j], 0.0);
+            s.params.grid.count = space_counts[j];
+            s.params.quad = quad;
+            r.count = space_counts[j];
+
+            r.name = "f";
+            run_bench(&bench_f, &s, &r);
+            print_result(out, format, &r, first);
+
+            r.name = "fdf";
+            run_bench(&bench_fdf, &s, &r);
+            print_result(out, format, &r, first);
+
+            quad_free(quad);
+        }
+
+        free_kernel_state(&s);
+
+        /* end-to-end sweep of the 6x6 grid */
+        s.p = make_problem(all_funcs + i, 6, 6, 10001);
+        r.count = s.p->space_grid.count;
+        r.name = "solve";
+        run_bench(&bench_solve, &s, &r);
+        print_result(out, format, &r, first);
+        free_problem(s.p);
+    }
+
+    if(strcmp(format, FORMAT_JSON) == 0){
+        fprintf(out, "\n  ]\n}\n");
+    }
+
+    if(out != stdout){
+        fclose(out);
+    }
+
+    /* the sink is printed to keep the operations from being optimized */
+    fprintf(stderr, "Checksum: %lg\n", s.sink);
+
+    return 0;
+}
@@ -0,0 +1,29 @@
+vector.o: vector.c vector.h
+vmath.o: vmath.c vmath.h
+quadrature.o: quadrature.c /tmp/gslstub/gsl/gsl_integration.h vector.h \
+ quadrature.h
+kernels.o: kernels.c kernels.h /tmp/gslstub/gsl/gsl_math.h \
+ /tmp/gslstub/gsl/gsl_vector.h /tmp/gslstub/gsl/gsl_matrix.h \
+ /tmp/gslstub/gsl/gsl_errno.h /tmp/gslstub/gsl/gsl_multiroots.h \
+ /tmp/gslstub/gsl/gsl_sf_gamma.h /tmp/gslstub/gsl/gsl_sf_psi.h vector.h \
+ vmath.h quadrature.h
+table.o: table.c table.h vector.h
+solver.o: solver.c solver.h /tmp/gslstub/gsl/gsl_errno.h \
+ /tmp/gslstub/gsl/gsl_math.h /tmp/gslstub/gsl/gsl_vector.h \
+ /tmp/gslstub/gsl/gsl_matrix.h /tmp/gslstub/gsl/gsl_errno.h \
+ /tmp/gslstub/gsl/gsl_multiroots.h kernels.h \
+ /tmp/gslstub/gsl/gsl_sf_gamma.h /tmp/gslstub/gsl/gsl_sf_psi.h vector.h \
+ vmath.h quadrature.h table.h telemetry.h
+output.o: output.c output.h solver.h /tmp/gslstub/gsl/gsl_errno.h \
+ /tmp/gslstub/gsl/gsl_math.h /tmp/gslstub/gsl/gsl_vector.h \
+ /tmp/gslstub/gsl/gsl_matrix.h /tmp/gslstub/gsl/gsl_errno.h \
+ /tmp/gslstub/gsl/gsl_multiroots.h kernels.h \
+ /tmp/gslstub/gsl/gsl_sf_gamma.h /tmp/gslstub/gsl/gsl_sf_psi.h vector.h \
+ vmath.h quadrature.h table.h telemetry.h
+telemetry.o: telemetry.c /tmp/gslstub/gsl/gsl_errno.h telemetry.h
+excess.o: excess.c solver.h /tmp/gslstub/gsl/gsl_errno.h \
+ /tmp/gslstub/gsl/gsl_math.h /tmp/gslstub/gsl/gsl_vector.h \
+ /tmp/gslstub/gsl/gsl_matrix.h /tmp/gslstub/gsl/gsl_errno.h \
+ /tmp/gslstub/gsl/gsl_multiroots.h kernels.h \
+ /tmp/gslstub/gsl/gsl_sf_gamma.h /tmp/gslstub/gsl/gsl_sf_psi.h vector.h \
+ vmath.h quadrature.h table.h telemetry.h excess.h
@@ -0,0 +1,156 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "solver.h"
+#include "excess.h"
+
+/*
+ * Solver context: the problem info of the options and the solving state
+ */
+struct excess_context{
+    struct problem_info p;
+    struct worker w;
+    struct table *table;
+};
+
+
+
+/*
+ * Guards the setting of the GSL error handler
+ */
+static pthread_once_t gsl_handler_once = PTHREAD_ONCE_INIT;
+
+
+
+/*
+ * Turns off the default GSL error handler, which aborts the process, so
+ * GSL errors come back to the caller as statuses
+ */
+static void set_gsl_handler(void)
+{
+    gsl_set_error_handler_off();
+}
+
+
+
+void excess_default_options(struct excess_options *o, char kern_type)
+{
+    o->kern_type = kern_type;
+    o->space_count = 10001;
+    o->space_dim = 1;
+    o->eps = 1e-6;
+    o->iter_count = 100;
+    o->quadrature = QUAD_SIMPSON;
+    o->table = NULL;
+    o->polish = 0;
+}
+
+
+
+struct excess_context *excess_alloc(const struct excess_options *o)
+{
+    struct excess_context *ctx;
+    struct problem_info *p;
+
+    if(o->space_count < 3 || o->space_dim < 1 || !(o->eps > 0) ||
+        o->iter_count < 1 || o->polish < 0 ||
+        (o->table != NULL && o->space_dim != 1))
+    {
+        return NULL;
+    }
+
+    pthread_once(&gsl_handler_once, set_gsl_handler);
+
+    ctx = calloc(1, sizeof(struct excess_context));
+    if(ctx == NULL){
+        return NULL;
+    }
+
+    p = &(ctx->p);
+    p->space_grid.count = o->space_count;
+    p->space_dim = o->space_dim;
+    p->row_first = 0;
+    p->row_stride = 1;
+    p->iter_count = o->iter_count;
+    p->eps = o->eps;
+    p->thread_count = 1;
+    p->accuracy = VM_FULL;
+    p->polish = o->polish;
+
+    if(set_kernel(p, o->kern_type) != 0){
+        free(ctx);
+        return NULL;
+    }
+
+    p->quad = quad_alloc(o->quadrature, o->space_count, QUAD_TOL * o->eps);
+    if(p->quad == NULL){
+        free(ctx);
+        return NULL;
+    }
+
+    if(o->table != NULL){
+        ctx->table = table_open(o->table);
+        if(ctx->table == NULL ||
+            ctx->table->header->kern_type != o->kern_type)
+        {
+            table_close(ctx->table);
+            quad_free(p->quad);
+            free(ctx);
+            return NULL;
+        }
+        p->table = ctx->table;
+    }
+
+    init_worker(&(ctx->w), p, p->accuracy);
+
+    return ctx;
+}
+
+
+
+void excess_free(struct excess_context *ctx)
+{
+    if(ctx == NULL){
+        return;
+    }
+
+    free_worker(&(ctx->w));
+    table_close(ctx->table);
+    quad_free(ctx->p.quad);
+    free(ctx);
+}
+
+
+
+int excess_solve(struct excess_context *ctx, double k, double d, double *a,
+    double *b)
+{
+    return solve_target(&(ctx->w), k, d, a, b);
+}
+
+
+
+int excess_solve_batch(struct excess_context *ctx, int count,
+    const double *k, const double *d, double *a, double *b, int *status)
+{
+    int failed = 0;
+    int res;
+    int i;
+
+    for(i = 0; i < count; i++){
+        res = solve_target(&(ctx->w), k[i], d[i], a + i, b + i);
+        failed += res != GSL_SUCCESS;
+        if(status != NULL){
+            status[i] = res;
+        }
+    }
+
+    return failed;
+}
+
+
+
+long excess_calls(const struct excess_context *ctx)
+{
+    return ctx->w.params.calls;
+}
@@ -0,0 +1,72 @@
+#ifndef EXCESS_MODULE_H
+#define EXCESS_MODULE_H
+
+/*
+ * Library interface of the solver. A context owns the GSL workspace, the
+ * quadrature rule and the evaluation cache, so queries allocate nothing
+ * and write nothing to the standard output. Contexts share no state, so
+ * threads may solve concurrently with their own contexts
+ */
+
+/*
+ * Options of a solver context
+ */
+struct excess_options{
+    char kern_type;             /* kernel type */
+    int space_count;            /* space node count */
+    int space_dim;              /* space dimension of the isotropic kernel */
+    double eps;                 /* solver precision */
+    int iter_count;             /* iteration max count */
+    char quadrature;            /* quadrature rule type */
+    const char *table;          /* inverse table file or NULL */
+    int polish;                 /* newton steps after table lookups */
+};
+
+/*
+ * Solver context
+ */
+struct excess_context;
+
+
+
+/*
+ * Fills the options with the defaults of the excess program for the
+ * kernel type
+ */
+void excess_default_options(struct excess_options *o, char kern_type);
+
+/*
+ * Creates a solver context. The first call turns the GSL error handler off
+ * for the process, so GSL errors such as a singular jacobian are returned
+ * as statuses instead of aborting. Returns NULL if the options are invalid,
+ * the table cannot be mapped or the memory is exhausted. Tables hold
+ * solutions in one dimension only
+ */
+struct excess_context *excess_alloc(const struct excess_options *o);
+
+/*
+ * Frees the context
+ */
+void excess_free(struct excess_context *ctx);
+
+/*
+ * Finds the kernel parameters of the excess kurtosis k and the standard
+ * deviation d. Returns the GSL status, GSL_SUCCESS if the solution has
+ * reached the precision
+ */
+int excess_solve(struct excess_context *ctx, double k, double d, double *a,
+    double *b);
+
+/*
+ * Solves count queries (k[i], d[i]) into a[i], b[i]. Statuses are written
+ * to status unless it is NULL. Returns the count of unsolved queries
+ */
+int excess_solve_batch(struct excess_context *ctx, int count,
+    const double *k, const double *d, double *a, double *b, int *status);
+
+/*
+ * Returns the count of kernel integrations made by the context
+ */
+long excess_calls(const struct excess_context *ctx);
+
+#endif
@@ -1,34 +1,13 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "vector.h"
+#include "kernels.h"
 
 #define N_COUNT 10000001
 
-typedef double (*Kernel)(double, double, double);
-
-double exp_rat_kernel(double x, double s0, double s1)
-{
-    double xx = x * x;
-    return exp(-0.5 * (s0 * xx + s1 * xx * xx) / (1.0 + xx));
-}
-
-double roughgarden_kernel(double x, double s, double g)
-{
-    return exp(-pow(fabs(x / s), g));    
-}
-
-struct kern_type {
-    char type;
-    Kernel kernel;
-} kern_types[] = {
-    { 'k', &exp_rat_kernel },
-    { 'r', &roughgarden_kernel }
-};
-
-
-
 void calculate(struct vector_func *func, double *k, double *d)
 {
     int i;
@@ -53,40 +32,6 @@ void calculate(struct vector_func *func, double *k, double *d)
 
 
 
-static double get_begin(Kernel kernel, double a, double b)
-{
-    double x = 0.0;
-    double step = 1e-5;
-
-    while(fabs(kernel(x, a, b)) > 1e-12){
-        x -= step;
-    }
-
-#   ifdef DEBUG
-    printf("Origin: %lf\n", x);
-#   endif
-
-    return x;
-}
-
-
-
-Kernel get_kernel(char kern_type)
-{
-    unsigned int i;
-    unsigned int kern_count = sizeof(kern_types) / sizeof(struct kern_type);
-
-    for(i = 0; i < kern_count; i++){
-        if(kern_types[i].type == kern_type){
-            return kern_types[i].kernel;
-        }
-    }
-
-    return NULL;
-}
-
-
-
 int main(int argc, const char **argv)
 {
     double a;
@@ -95,9 +40,10 @@ int main(int argc, const char **argv)
     double k;
     double d;
     int i;
+    int accuracy;
     double x;
     struct vector_func func;
-    Kernel kernel; 
+    const struct kernel *kernel;
 
     kern = argv[1][0];
     kernel = get_kernel(kern);
@@ -108,16 +54,34 @@ int main(int argc, const char **argv)
 
     sscanf(argv[2], "%lf", &a);
     sscanf(argv[3], "%lf", &b);
+    accuracy = argc > 4 && strcmp(argv[4], "fast") == 0 ? VM_FAST : VM_FULL;
+
+    if(argc > 4 && strcmp(argv[4], "exact") == 0){
+        if(get_exact_values(kernel, a, b, 1, &k, &d) != GSL_SUCCESS){
+            fprintf(stderr, "### Kernel has no closed-form moments!\n");
+            return 1;
+        }
+
+        printf("k = %lf, d = %lf\n", k, d);
+        return 0;
+    }
+
+    func.grid.origin = x = get_origin(kernel, a, b);
+    if(!isfinite(func.grid.origin)){
+        fprintf(stderr, "### Kernel has no tail for given parameters!\n");
+        return 1;
+    }
 
     func.storage = malloc(sizeof(double) * N_COUNT);
-    func.grid.origin = x = get_begin(kernel, a, b);
     func.grid.count = N_COUNT;
     func.grid.step = 2 * fabs(func.grid.origin) / (N_COUNT - 1);
     for(i = 0; i < N_COUNT; i++){
-        func.storage[i] = kernel(x, a, b);
+        func.storage[i] = x;
         x += func.grid.step;
     }
 
+    kernel->block(func.storage, func.storage, N_COUNT, a, b, accuracy);
+
     calculate(&func, &k, &d);
     printf("k = %lf, d = %lf\n", k, d);
 
@@ -1,19 +1,96 @@
 #include "kernels.h"
+#include "vmath.h"
+#include "quadrature.h"
 
-typedef double (*Func)(double, double, double);
+/*
+ * Kernel value that is considered as the end of its tail
+ */
+#define TAIL_EPS 1e-12
+#define TAIL_LOG 27.631021115928547     /* -log(TAIL_EPS) */
+
+/*
+ * Bounds for the tail search: the maximal half-width of integration space,
+ * the relative precision of the found bound and the iteration limit
+ */
+#define TAIL_MAX 1e12
+#define TAIL_TOL 1e-10
+#define TAIL_ITER 200
 
 /*
- * Gets an origin of integration
+ * Logarithmic distance from the kernel value to the tail threshold
  */
-static double get_origin(Func kernel, double a, double b)
+static double tail_log(Func kernel, double x, double a, double b)
 {
-    double x = 0.0;
-    double step = 1e-5;
+    return log(fabs(kernel(x, a, b))) + TAIL_LOG;
+}
+
+
 
-    while(fabs(kernel(x, a, b)) > 1e-12){
-        x -= step;
+/*
+ * Finds the left tail bound of the kernel. The bound is bracketed by
+ * doubling the interval, then refined by the Illinois method on the kernel
+ * logarithm, that is smooth and nearly polynomial in the tail
+ */
+static double find_tail(Func kernel, double a, double b)
+{
+    double lo = 0.0;
+    double hi = 1.0;
+    double glo = tail_log(kernel, 0.0, a, b);
+    double ghi;
+    double mid;
+    double gmid;
+    int side = 0;
+    int iter;
+
+    if(!(glo > 0)){
+        return 0.0;
     }
 
+    while((ghi = tail_log(kernel, -hi, a, b)) > 0){
+        lo = hi;
+        glo = ghi;
+        hi *= 2;
+
+        if(hi > TAIL_MAX){
+            return NAN;
+        }
+    }
+
+    for(iter = 0; iter < TAIL_ITER && hi - lo > TAIL_TOL * hi; iter++){
+        mid = hi - ghi * (hi - lo) / (ghi - glo);
+        if(!(mid > lo && mid < hi)){
+            mid = 0.5 * (lo + hi);
+        }
+
+        gmid = tail_log(kernel, -mid, a, b);
+        if(gmid > 0){
+            lo = mid;
+            glo = gmid;
+            if(side == -1){
+                ghi *= 0.5;
+            }
+            side = -1;
+        }else{
+            hi = mid;
+            ghi = gmid;
+            if(side == 1){
+                glo *= 0.5;
+            }
+            side = 1;
+        }
+    }
+
+    return -hi;
+}
+
+
+
+double get_origin(const struct kernel *kern, double a, double b)
+{
+    double x = kern->tail != NULL
+        ? kern->tail(a, b)
+        : find_tail(kern->value, a, b);
+
 #   ifdef DEBUG
     printf("Origin: %lf\n", x);
 #   endif
@@ -24,51 +101,343 @@ static double get_origin(Func kernel, double a, double b)
 
 
 /*
- * Gets current dispertion and excess kurtosis of the kernel
+ * Kernel integrals needed for the values and the jacobian. Parameter
+ * derivatives of the kernel are dK/da = Fa K and dK/db = Fb K. In the space
+ * dimension D > 1 the kernel is isotropic and x is the radius: integrands
+ * get the |x|^(D - 1) weight of the spherical layer, so the integrals are
+ * the radial moments up to a constant factor
+ */
+#define MOM_NORM 0              /* integral of |K| */
+#define MOM_X2 1                /* integral of x^2 K */
+#define MOM_X4 2                /* integral of x^4 K */
+#define MOM_A0 3                /* integral of dK/da */
+#define MOM_A2 4                /* integral of x^2 dK/da */
+#define MOM_A4 5                /* integral of x^4 dK/da */
+#define MOM_B0 6                /* integral of dK/db */
+#define MOM_B2 7                /* integral of x^2 dK/db */
+#define MOM_B4 8                /* integral of x^4 dK/db */
+
+#define MOM_VALUES 3            /* count of integrals for values */
+
+/*
+ * Kernel and its parameters for the moment integrand
  */
-static void get_current_values_f(
-    Func kernel,
-    double *k,
-    double *d,
+struct moment_task{
+    const struct kernel *kern;
+    double a;
+    double b;
+    int accuracy;
+    int space_dim;              /* space dimension */
+    int dim;                    /* MOM_VALUES or MOM_COUNT */
+};
+
+
+
+/*
+ * Multiplies the values by x^2 and x^4 into the rows of the integrand
+ */
+static void add_powers(const double *xx, const double *v, double *v2,
+    double *v4, int n)
+{
+    int i;
+
+    for(i = 0; i < n; i++){
+        v2[i] = v[i] * xx[i];
+        v4[i] = v2[i] * xx[i];
+    }
+}
+
+
+
+/*
+ * Multiplies the values by the radial weight |x|^(D - 1)
+ */
+static void add_radial_weight(const double *x, double *v, int n, int dim)
+{
+    double r;
+    double w;
+    int i;
+    int j;
+
+    for(i = 0; i < n; i++){
+        r = fabs(x[i]);
+        w = r;
+        for(j = 2; j < dim; j++){
+            w *= r;
+        }
+        v[i] *= w;
+    }
+}
+
+
+
+/*
+ * Moment integrand: kernel values and derivative factors are evaluated by
+ * one block call each and multiplied by the powers of x in place. The
+ * radial weight goes into the kernel values, so the derivative integrands
+ * get it too. Derivative integrands are calculated only if the task needs
+ * all the integrals
+ */
+static void moment_values(const double *x, int n, double *f, void *ctx)
+{
+    const struct moment_task *task = (const struct moment_task *)ctx;
+    double xx[QUAD_BLOCK];
+    double *fa = f + MOM_A0 * n;
+    double *fb = f + MOM_B0 * n;
+    int i;
+
+    task->kern->block(x, f, n, task->a, task->b, task->accuracy);
+
+    if(task->space_dim > 1){
+        add_radial_weight(x, f, n, task->space_dim);
+    }
+
+    for(i = 0; i < n; i++){
+        xx[i] = x[i] * x[i];
+    }
+
+    add_powers(xx, f, f + MOM_X2 * n, f + MOM_X4 * n, n);
+
+    if(task->dim == MOM_COUNT){
+        task->kern->deriv(x, fa, fb, n, task->a, task->b, task->accuracy);
+        for(i = 0; i < n; i++){
+            fa[i] *= f[i];
+            fb[i] *= f[i];
+        }
+
+        add_powers(xx, fa, f + MOM_A2 * n, f + MOM_A4 * n, n);
+        add_powers(xx, fb, f + MOM_B2 * n, f + MOM_B4 * n, n);
+    }
+
+    for(i = 0; i < n; i++){
+        f[MOM_NORM * n + i] = fabs(f[i]);
+    }
+}
+
+
+
+/*
+ * Calculates kernel integrals over the space between the tail bounds
+ * with the quadrature rule of the params. Integrals for the jacobian are
+ * calculated only if the flag is set. Returns GSL_ETOL if the rule has
+ * not reached its tolerance
+ */
+static int get_moments(
+    const struct kernel *kern,
     double a,
     double b,
-    struct vector_func *buf
+    const struct params *p,
+    int jacobian,
+    double *m
 )
 {
-    double norm;
-    double x;
-    int i;
+    struct moment_task task;
+
+    task.kern = kern;
+    task.a = a;
+    task.b = b;
+    task.accuracy = p->accuracy;
+    task.space_dim = p->space_dim;
+    task.dim = jacobian ? MOM_COUNT : MOM_VALUES;
+
+    if(quad_integrate(p->quad, &moment_values, &task, task.dim,
+        fabs(p->grid.origin), kern->symmetric, m, NULL) < 0)
+    {
+        return GSL_ETOL;
+    }
+
+    return GSL_SUCCESS;
+}
 
-    buf->grid.origin = get_origin(kernel, a, b);
-    buf->grid.step = 2 * fabs(buf->grid.origin) / (buf->grid.count - 1);
 
-    x = buf->grid.origin;
-    for(i = 0; i < buf->grid.count; i++){
-        buf->storage[i] = kernel(x, a, b);
-        x += buf->grid.step;
+
+/*
+ * Sets integration grid for the given kernel parameters. Returns GSL_EDOM
+ * if the kernel has no tail for these parameters
+ */
+static int set_grid(
+    const struct kernel *kern,
+    double a,
+    double b,
+    struct linspace *grid
+)
+{
+    grid->origin = get_origin(kern, a, b);
+    grid->step = 2 * fabs(grid->origin) / (grid->count - 1);
+
+    return isfinite(grid->origin) ? GSL_SUCCESS : GSL_EDOM;
+}
+
+
+
+/*
+ * Gets factors of the coordinate moments by the radial ones in the space
+ * dimension D: E[x1^2] = E[r^2] / D and E[x1^4] = 3 E[r^4] / D(D + 2).
+ * Both are 1 in one dimension
+ */
+static void get_dim_factors(int dim, double *c2, double *c4)
+{
+    *c2 = 1.0 / dim;
+    *c4 = 3.0 / (dim * (dim + 2));
+}
+
+
+
+/*
+ * Gets dispertion and excess kurtosis from calculated integrals. They are
+ * the moments of a coordinate of the space
+ */
+static void set_values(const double *m, int space_dim, double *k, double *d)
+{
+    double c2;
+    double c4;
+
+    get_dim_factors(space_dim, &c2, &c4);
+
+    *d = c2 * m[MOM_X2] / m[MOM_NORM];
+    *k = c4 * m[MOM_X4] / m[MOM_NORM] / (*d) / (*d) - 3;
+}
+
+
+
+/*
+ * Fills the jacobian of excess kurtosis and dispersion using calculated
+ * integrals. With mu = c4 M4 / M0 and d = c2 M2 / M0 for the moments Mi
+ * and the factors of get_dim_factors:
+ *
+ *     dd/dp = (c2 dM2/dp - d dM0/dp) / M0
+ *     dmu/dp = (c4 dM4/dp - mu dM0/dp) / M0
+ *     dk/dp = dmu/dp / d^2 - 2 mu dd/dp / d^3
+ */
+static void set_jacobian(const double *m, int space_dim, gsl_matrix *J)
+{
+    double c2;
+    double c4;
+    double d;
+    double mu;
+    double dd;
+    double dda;
+    double ddb;
+    double dmua;
+    double dmub;
+    double dka;
+    double dkb;
+
+    get_dim_factors(space_dim, &c2, &c4);
+
+    d = c2 * m[MOM_X2] / m[MOM_NORM];
+    mu = c4 * m[MOM_X4] / m[MOM_NORM];
+    dd = d * d;
+    dda = (c2 * m[MOM_A2] - d * m[MOM_A0]) / m[MOM_NORM];
+    ddb = (c2 * m[MOM_B2] - d * m[MOM_B0]) / m[MOM_NORM];
+    dmua = (c4 * m[MOM_A4] - mu * m[MOM_A0]) / m[MOM_NORM];
+    dmub = (c4 * m[MOM_B4] - mu * m[MOM_B0]) / m[MOM_NORM];
+    dka = dmua / dd - 2 * mu * dda / (dd * d);
+    dkb = dmub / dd - 2 * mu * ddb / (dd * d);
+
+    gsl_matrix_set(J, 0, 0, dka);
+    gsl_matrix_set(J, 0, 1, dkb);
+    gsl_matrix_set(J, 1, 0, dda);
+    gsl_matrix_set(J, 1, 1, ddb);
+
+#   ifdef DEBUG
+    printf("J = [ %10.3lf, %10.3lf ]\n", dka, dkb);
+    printf("    [ %10.3lf, %10.3lf ]\n", dda, ddb);
+#   endif
+}
+
+
+
+/*
+ * Evaluates kernel integrals into the cache, unless it already holds them
+ * for these parameters. Derivative integrals are evaluated if the
+ * jacobian is asked, or if f evaluations of the params prefetch them for
+ * the following jacobian request at the same point
+ */
+static const struct eval_cache *evaluate(
+    const struct kernel *kern,
+    double a,
+    double b,
+    struct params *p,
+    int jacobian
+)
+{
+    struct eval_cache *c = &(p->cache);
+
+    jacobian = jacobian || p->prefetch;
+    if(c->kern == kern && c->a == a && c->b == b &&
+        (c->jacobian || !jacobian))
+    {
+        p->grid.origin = c->origin;
+        return c;
     }
 
-    norm = get_norm(buf);
+    c->kern = kern;
+    c->a = a;
+    c->b = b;
+    c->jacobian = jacobian;
+    c->status = set_grid(kern, a, b, &(p->grid));
+    c->origin = p->grid.origin;
+
+    if(c->status != GSL_SUCCESS){
+        return c;
+    }
 
-    x = buf->grid.origin;
-    for(i = 0; i < buf->grid.count; i++){
-        buf->storage[i] *= x * x;
-        x += buf->grid.step;
+    if(p->quad->type == QUAD_EXACT && kern->moments != NULL){
+        c->status = kern->moments(a, b, p->space_dim, c->m);
+        c->jacobian = 1;
+    }else{
+        c->status = get_moments(kern, a, b, p, jacobian, c->m);
+        p->calls++;
     }
 
-    *d = get_integral(buf) / norm;
+    return c;
+}
+
 
-    x = buf->grid.origin;
-    for(i = 0; i < buf->grid.count; i++){
-        buf->storage[i] *= x * x;
-        x += buf->grid.step;
+
+/*
+ * Residuals of the kernel excess kurtosis and dispersion, the jacobian is
+ * filled if it is not NULL. Returns GSL_EDOM if the kernel has no tail and
+ * GSL_ETOL if its integrals have not converged
+ */
+static int get_residuals(
+    const struct kernel *kern,
+    const gsl_vector *x,
+    struct params *p,
+    gsl_vector *f,
+    gsl_matrix *J
+)
+{
+    const struct eval_cache *c;
+    const double *m;
+    double a = gsl_vector_get(x, 0);
+    double b = gsl_vector_get(x, 1);
+    double curr_k;
+    double curr_d;
+
+    c = evaluate(kern, a, b, p, J != NULL);
+    if(c->status != GSL_SUCCESS){
+        return c->status;
     }
 
-    *k = get_integral(buf) / norm / (*d) / (*d) - 3;
+    m = c->m;
+
+    if(f != NULL){
+        set_values(m, p->space_dim, &curr_k, &curr_d);
+        gsl_vector_set(f, 0, curr_k - p->k);
+        gsl_vector_set(f, 1, curr_d - p->d);
 #       ifdef DEBUG
-        printf("k = %lf, d = %lf\n", *k, *d);
+        printf("k = %lf, d = %lf\n", curr_k, curr_d);
         printf("{a = %lf, b = %lf}\n", a, b);
 #       endif
+    }
+
+    if(J != NULL){
+        set_jacobian(m, p->space_dim, J);
+    }
+
+    return GSL_SUCCESS;
 }
 
 
@@ -82,273 +451,300 @@ inline static double kurtic_kernel(double x, double s0, double s1)
     return exp(-0.5 * (s0 * xx + s1 * xx * xx) / (1 + xx));
 }
 
+static void kurtic_block(const double *x, double *y, int n, double s0,
+    double s1, int accuracy)
+{
+    double xx;
+    int i;
 
+    for(i = 0; i < n; i++){
+        xx = x[i] * x[i];
+        y[i] = -0.5 * (s0 * xx + s1 * xx * xx) / (1 + xx);
+    }
 
-static void get_current_kurtic_values_df(
-    double s0,
-    double s1,
-    struct vector_func *buf,
-    gsl_matrix *J
-)
+    vm_exp(y, n, accuracy);
+}
+
+/*
+ * dK/ds0 = -x^2 / 2(1 + x^2) K, dK/ds1 = -x^4 / 2(1 + x^2) K
+ */
+static void kurtic_deriv(const double *x, double *da, double *db, int n,
+    double s0, double s1, int accuracy)
 {
-    double norm;
-    double mu;
-    double sgm;
-    double dsgms0;
-    double dsgms1;
-    double dmus0;
-    double dmus1;
-    double x;
     double xx;
-    double d;
-    double dd;
-    double d4;
-    double tmp;
     int i;
 
-    buf->grid.origin = get_origin(&kurtic_kernel, s0, s1);
-    buf->grid.step = 2 * fabs(buf->grid.origin) / (buf->grid.count - 1);
-
-    x = buf->grid.origin;
-    for(i = 0; i < buf->grid.count; i++){
-        buf->storage[i] = kurtic_kernel(x, s0, s1);
-        x += buf->grid.step;
+    for(i = 0; i < n; i++){
+        xx = x[i] * x[i];
+        da[i] = -0.5 * xx / (1 + xx);
+        db[i] = da[i] * xx;
     }
+}
 
-    norm = get_norm(buf);
+static const struct kernel kurtic = {
+    KURTIC, &kurtic_kernel, &kurtic_block, &kurtic_deriv, NULL, NULL, 1,
+    1.0
+};
 
-    x = buf->grid.origin;
-    for(i = 0; i < buf->grid.count; i++){
-        buf->storage[i] *= x * x;
-        x += buf->grid.step;
-    }
 
-    sgm = get_integral(buf);
-    d = sgm / norm;
-    dd = d * d;
 
-    x = buf->grid.origin;
-    for(i = 0; i < buf->grid.count; i++){
-        buf->storage[i] *= x * x;
-        x += buf->grid.step;
-    }
+int kurtic_fdf(const gsl_vector *x, void *params, gsl_vector *f,
+    gsl_matrix *J)
+{
+    return get_residuals(&kurtic, x, (struct params *)params, f, J);
+}
 
-    mu = get_integral(buf) / norm;
 
-    x = buf->grid.origin;
-    for(i = 0; i < buf->grid.count; i++){
-        xx = x * x;
-        buf->storage[i] /= 1 + xx;
-        x += buf->grid.step;
-    }
 
-    dsgms0 = -0.5 * get_integral(buf) / norm;
+int kurtic_df(const gsl_vector *x, void *params, gsl_matrix *J)
+{
+    return get_residuals(&kurtic, x, (struct params *)params, NULL, J);
+}
 
-    x = buf->grid.origin;
-    for(i = 0; i < buf->grid.count; i++){
-        buf->storage[i] *= x * x;
-        x += buf->grid.step;
-    }
 
-    dsgms1 = -0.5 * get_integral(buf) / norm;
 
-    d4 = dd * dd;
-    dmus0 = dsgms1 / dd - 2 * mu * d * dsgms0 / d4;
+int kurtic_f(const gsl_vector *x, void *params, gsl_vector *f)
+{
+    return get_residuals(&kurtic, x, (struct params *)params, f, NULL);
+}
 
-    x = buf->grid.origin;
-    for(i = 0; i < buf->grid.count; i++){
-        buf->storage[i] *= x * x;
-        x += buf->grid.step;
-    }
 
-    tmp = -0.5 * get_integral(buf) / norm;
-    dmus1 = tmp / dd - 2 * mu * d * dsgms1 / d4;
 
-    gsl_matrix_set(J, 0, 0, dmus0);
-    gsl_matrix_set(J, 0, 1, dmus1);
-    gsl_matrix_set(J, 1, 0, dsgms0);
-    gsl_matrix_set(J, 1, 1, dsgms1);
 
-#   ifdef DEBUG
-    printf("J = [ %10.3lf, %10.3lf ]\n", dmus0, dmus1);
-    printf("    [ %10.3lf, %10.3lf ]\n", dsgms0, dsgms1);
-#   endif
-}
 
 
 
-static void get_current_kurtic_values_fdf(
-    double *k,
-    double *d,
-    double s0,
-    double s1,
-    struct vector_func *buf,
-    gsl_matrix *J
-)
+
+/*=======================================================================*/
+/*                          Roughgarden kernel                           */
+/*=======================================================================*/
+inline static double rgarden_kernel(double x, double s, double g)
 {
-    double norm;
-    double mu;
-    double sgm;
-    double dsgms0;
-    double dsgms1;
-    double dmus0;
-    double dmus1;
-    double x;
-    double xx;
-    double dd;
-    double d4;
-    double tmp;
-    int i;
+    return exp(-pow(fabs(x / s), g));
+}
 
-    buf->grid.origin = get_origin(&kurtic_kernel, s0, s1);
-    buf->grid.step = 2 * fabs(buf->grid.origin) / (buf->grid.count - 1);
 
-    x = buf->grid.origin;
-    for(i = 0; i < buf->grid.count; i++){
-        buf->storage[i] = kurtic_kernel(x, s0, s1);
-        x += buf->grid.step;
+
+/*
+ * Roughgarden kernel tail: |x / s|^g = -log(TAIL_EPS)
+ */
+static double rgarden_tail(double s, double g)
+{
+    if(!(g > 0)){
+        return NAN;
     }
 
-    norm = get_norm(buf);
+    return -fabs(s) * pow(TAIL_LOG, 1 / g);
+}
 
-    x = buf->grid.origin;
-    for(i = 0; i < buf->grid.count; i++){
-        buf->storage[i] *= x * x;
-        x += buf->grid.step;
+/*
+ * Calculated as exp(-exp(g log|x / s|)). Inside the integration space the
+ * inner exponent is below TAIL_LOG, so its relative error is amplified by
+ * this value in the kernel
+ */
+static void rgarden_block(const double *x, double *y, int n, double s,
+    double g, int accuracy)
+{
+    int i;
+
+    for(i = 0; i < n; i++){
+        y[i] = fabs(x[i] / s);
     }
 
-    sgm = get_integral(buf);
-    *d = sgm / norm;
+    vm_log(y, n);
+    for(i = 0; i < n; i++){
+        y[i] *= g;
+    }
 
-    x = buf->grid.origin;
-    for(i = 0; i < buf->grid.count; i++){
-        buf->storage[i] *= x * x;
-        x += buf->grid.step;
+    vm_exp(y, n, accuracy);
+    for(i = 0; i < n; i++){
+        y[i] = -y[i];
     }
 
-    mu = get_integral(buf) / norm;
-    dd = (*d) * (*d);
-    *k = mu / dd - 3;
+    vm_exp(y, n, accuracy);
+}
 
-    x = buf->grid.origin;
-    for(i = 0; i < buf->grid.count; i++){
-        xx = x * x;
-        buf->storage[i] /= 1 + xx;
-        x += buf->grid.step;
-    }
+/*
+ * With u = |x / s|^g: dK/ds = g u / s K, dK/dg = -u log|x / s| K. Both
+ * factors vanish at zero, where the logarithm is infinite
+ */
+static void rgarden_deriv(const double *x, double *da, double *db, int n,
+    double s, double g, int accuracy)
+{
+    int i;
 
-    dsgms0 = -0.5 * get_integral(buf) / norm;
+    for(i = 0; i < n; i++){
+        db[i] = fabs(x[i] / s);
+    }
 
-    x = buf->grid.origin;
-    for(i = 0; i < buf->grid.count; i++){
-        buf->storage[i] *= x * x;
-        x += buf->grid.step;
+    vm_log(db, n);
+    for(i = 0; i < n; i++){
+        da[i] = g * db[i];
     }
 
-    dsgms1 = -0.5 * get_integral(buf) / norm;
+    vm_exp(da, n, accuracy);
+    for(i = 0; i < n; i++){
+        if(x[i] == 0){
+            da[i] = db[i] = 0.0;
+        }else{
+            db[i] *= -da[i];
+            da[i] *= g / s;
+        }
+    }
+}
 
-    d4 = dd * dd;
-    dmus0 = dsgms1 / dd - 2 * mu * (*d) * dsgms0 / d4;
+/*
+ * Roughgarden kernel radial moments in the space dimension D, divided by
+ * the norm:
+ *
+ *     M_n = 2 |s|^(n + D) G((n + D) / g) / g
+ *     dM_n/ds = (n + D) M_n / s
+ *     dM_n/dg = -M_n ((n + D) / g^2 psi((n + D) / g) + 1 / g)
+ *
+ * Gamma functions ratios are taken from their logarithms, as the gamma
+ * functions themselves overflow for small g
+ */
+static int rgarden_moments(double s, double g, int dim, double *m)
+{
+    double lg1;
+    double c;
+    int n;
 
-    x = buf->grid.origin;
-    for(i = 0; i < buf->grid.count; i++){
-        buf->storage[i] *= x * x;
-        x += buf->grid.step;
+    if(!(g > 0) || s == 0){
+        return GSL_EDOM;
     }
 
-    tmp = -0.5 * get_integral(buf) / norm;
-    dmus1 = tmp / dd - 2 * mu * (*d) * dsgms1 / d4;
+    lg1 = gsl_sf_lngamma((double)dim / g);
+    for(n = 0; n <= 4; n += 2){
+        c = (double)(n + dim) / g;
+        m[MOM_NORM + n / 2] = pow(fabs(s), n) *
+            exp(gsl_sf_lngamma(c) - lg1);
+        m[MOM_A0 + n / 2] = (n + dim) * m[MOM_NORM + n / 2] / s;
+        m[MOM_B0 + n / 2] = -m[MOM_NORM + n / 2] *
+            (c / g * gsl_sf_psi(c) + 1 / g);
+    }
 
-    gsl_matrix_set(J, 0, 0, dmus0);
-    gsl_matrix_set(J, 0, 1, dmus1);
-    gsl_matrix_set(J, 1, 0, dsgms0);
-    gsl_matrix_set(J, 1, 1, dsgms1);
+    return GSL_SUCCESS;
 }
 
+static const struct kernel rgarden = {
+    RGARDEN, &rgarden_kernel, &rgarden_block, &rgarden_deriv,
+    &rgarden_tail, &rgarden_moments, 1, 1 + TAIL_LOG
+};
 
 
-int kurtic_fdf(const gsl_vector *x, void *params, gsl_vector *f,
+
+int rgarden_fdf(const gsl_vector *x, void *params, gsl_vector *f,
     gsl_matrix *J)
 {
-    struct params *p = (struct params *)params;
-    double curr_k;
-    double curr_d;
-    double s0 = gsl_vector_get(x, 0);
-    double s1 = gsl_vector_get(x, 1);
+    return get_residuals(&rgarden, x, (struct params *)params, f, J);
+}
 
-    get_current_kurtic_values_fdf(&curr_k, &curr_d, s0, s1, &(p->buffer),
-        J);
 
-    gsl_vector_set(f, 0, curr_k - p->k);
-    gsl_vector_set(f, 1, curr_d - p->d);
 
-    return GSL_SUCCESS;
+int rgarden_df(const gsl_vector *x, void *params, gsl_matrix *J)
+{
+    return get_residuals(&rgarden, x, (struct params *)params, NULL, J);
 }
 
 
 
-int kurtic_df(const gsl_vector *x, void *params, gsl_matrix *J)
+int rgarden_f(const gsl_vector *x, void *params, gsl_vector *f)
 {
-    struct params *p = (struct params *)params;
-    double s0 = gsl_vector_get(x, 0);
-    double s1 = gsl_vector_get(x, 1);
+    return get_residuals(&rgarden, x, (struct params *)params, f, NULL);
+}
 
-    get_current_kurtic_values_df(s0, s1, &(p->buffer), J);
 
-    return GSL_SUCCESS;
+
+
+
+
+
+/*=======================================================================*/
+/*                       Exponent polynomial kernel                      */
+/*=======================================================================*/
+inline static double polyexp_kernel(double x, double a, double b)
+{
+    double xx = x * x;
+    return exp(-a * xx - b * xx * xx);
 }
 
 
 
-int kurtic_f(const gsl_vector *x, void *params, gsl_vector *f)
+/*
+ * Exponent polynomial kernel tail: the first positive root of
+ * b x^4 + a x^2 = -log(TAIL_EPS), written in the cancellation-free form
+ */
+static double polyexp_tail(double a, double b)
 {
-    struct params *p = (struct params *)params;
-    double curr_k;
-    double curr_d;
-    double s0 = gsl_vector_get(x, 0);
-    double s1 = gsl_vector_get(x, 1);
+    double disc = a * a + 4 * b * TAIL_LOG;
+    double den;
 
-    get_current_values_f(&kurtic_kernel, &curr_k, &curr_d, s0, s1,
-        &(p->buffer));
+    if(disc < 0){
+        return NAN;
+    }
 
-    gsl_vector_set(f, 0, curr_k - p->k);
-    gsl_vector_set(f, 1, curr_d - p->d);
+    den = a + sqrt(disc);
+    if(!(den > 0)){
+        return NAN;
+    }
 
-    return GSL_SUCCESS;
+    return -sqrt(2 * TAIL_LOG / den);
 }
 
+static void polyexp_block(const double *x, double *y, int n, double a,
+    double b, int accuracy)
+{
+    double xx;
+    int i;
 
+    for(i = 0; i < n; i++){
+        xx = x[i] * x[i];
+        y[i] = -a * xx - b * xx * xx;
+    }
 
+    vm_exp(y, n, accuracy);
+}
 
+/*
+ * dK/da = -x^2 K, dK/db = -x^4 K
+ */
+static void polyexp_deriv(const double *x, double *da, double *db, int n,
+    double a, double b, int accuracy)
+{
+    int i;
 
+    for(i = 0; i < n; i++){
+        da[i] = -x[i] * x[i];
+        db[i] = da[i] * x[i] * x[i];
+    }
+}
 
+static const struct kernel polyexp = {
+    POLYEXP, &polyexp_kernel, &polyexp_block, &polyexp_deriv,
+    &polyexp_tail, NULL, 1, 1.0
+};
 
 
-/*=======================================================================*/
-/*                          Roughgarden kernel                           */
-/*=======================================================================*/
-inline static double rgarden_kernel(double x, double s, double g)
+
+int polyexp_fdf(const gsl_vector *x, void *params, gsl_vector *f,
+    gsl_matrix *J)
 {
-    return exp(-pow(fabs(x / s), g));
+    return get_residuals(&polyexp, x, (struct params *)params, f, J);
 }
 
 
 
-int rgarden_f(const gsl_vector *x, void *params, gsl_vector *f)
+int polyexp_df(const gsl_vector *x, void *params, gsl_matrix *J)
 {
-    struct params *rgarden_params = (struct params *)params;
-    double s = gsl_vector_get(x, 0);
-    double g = gsl_vector_get(x, 1);
-    double curr_k;
-    double curr_d;
+    return get_residuals(&polyexp, x, (struct params *)params, NULL, J);
+}
 
-    get_current_values_f(&rgarden_kernel, &curr_k, &curr_d, s, g,
-        &(rgarden_params->buffer));
-    
-    gsl_vector_set(f, 0, curr_k - rgarden_params->k);
-    gsl_vector_set(f, 1, curr_d - rgarden_params->d);
 
-    return GSL_SUCCESS;
+
+int polyexp_f(const gsl_vector *x, void *params, gsl_vector *f)
+{
+    return get_residuals(&polyexp, x, (struct params *)params, f, NULL);
 }
 
 
@@ -357,30 +753,57 @@ int rgarden_f(const gsl_vector *x, void *params, gsl_vector *f)
 
 
 
+
 /*=======================================================================*/
-/*                       Exponent polynomial kernel                      */
+/*                             Kernel table                              */
 /*=======================================================================*/
-inline static double polyexp_kernel(double x, double a, double b)
+static const struct kernel *kernels[] = { &kurtic, &rgarden, &polyexp };
+
+
+
+void clear_cache(struct params *p)
 {
-    double xx = x * x;
-    return exp(-a * xx - b * xx * xx);
+    p->cache.kern = NULL;
+    p->calls = 0;
 }
 
 
 
-int polyexp_f(const gsl_vector *x, void *params, gsl_vector *f)
+int get_exact_values(const struct kernel *kern, double a, double b,
+    int space_dim, double *k, double *d)
 {
-    struct params *polyexp_params = (struct params *)params;
-    double s = gsl_vector_get(x, 0);
-    double g = gsl_vector_get(x, 1);
-    double curr_k;
-    double curr_d;
+    double m[MOM_COUNT];
+
+    if(kern->moments == NULL ||
+        kern->moments(a, b, space_dim, m) != GSL_SUCCESS)
+    {
+        return GSL_EDOM;
+    }
 
-    get_current_values_f(&polyexp_kernel, &curr_k, &curr_d, s, g,
-        &(polyexp_params->buffer));
-    
-    gsl_vector_set(f, 0, curr_k - polyexp_params->k);
-    gsl_vector_set(f, 1, curr_d - polyexp_params->d);
+    set_values(m, space_dim, k, d);
 
     return GSL_SUCCESS;
 }
+
+
+
+double get_kernel_error(const struct kernel *kern, int accuracy)
+{
+    return kern->gain * vm_exp_error(accuracy);
+}
+
+
+
+const struct kernel *get_kernel(char type)
+{
+    unsigned int i;
+    unsigned int count = sizeof(kernels) / sizeof(kernels[0]);
+
+    for(i = 0; i < count; i++){
+        if(kernels[i]->type == type){
+            return kernels[i];
+        }
+    }
+
+    return NULL;
+}
@@ -4,8 +4,59 @@
 #include <math.h>
 #include <gsl/gsl_math.h>
 #include <gsl/gsl_multiroots.h>
+#include <gsl/gsl_sf_gamma.h>
+#include <gsl/gsl_sf_psi.h>
 
 #include "vector.h"
+#include "vmath.h"
+#include "quadrature.h"
+
+/*
+ * Avaliable kernel types
+ */
+#define KURTIC 'k'
+#define RGARDEN 'r'
+#define POLYEXP 'p'
+
+typedef double (*Func)(double, double, double);
+typedef double (*Tail)(double, double);
+typedef void (*Block)(const double *, double *, int, double, double, int);
+typedef void (*Deriv)(const double *, double *, double *, int, double,
+    double, int);
+typedef int (*Moments)(double, double, int, double *);
+
+/*
+ * Kernel representation
+ */
+struct kernel{
+    char type;                  /* kernel type */
+    Func value;                 /* kernel function K(x, a, b) */
+    Block block;                /* values on points array, may be in place */
+    Deriv deriv;                /* factors Fa, Fb of dK/da = Fa K, dK/db */
+    Tail tail;                  /* analytical origin, NULL if unknown */
+    Moments moments;            /* closed-form integrals, NULL if unknown */
+    int symmetric;              /* whether the kernel is even in x */
+    double gain;                /* kernel error per vm_exp error */
+};
+
+/*
+ * Count of kernel integrals: the moments and their parameter derivatives
+ */
+#define MOM_COUNT 9
+
+/*
+ * Last evaluated kernel integrals, reused by requests at the same kernel
+ * parameters. The jacobian is assembled from the integrals
+ */
+struct eval_cache{
+    const struct kernel *kern;  /* kernel of the entry, NULL if empty */
+    double a;                   /* kernel parameters of the entry */
+    double b;
+    int status;                 /* status of the evaluation */
+    int jacobian;               /* whether derivative integrals are kept */
+    double origin;              /* integration origin */
+    double m[MOM_COUNT];        /* integrals */
+};
 
 /*
  * Params for calculation method
@@ -14,10 +65,49 @@ struct params{
     double k;                   /* excess kurtosis value */
     double d;                   /* dispersion value */
 
-    struct vector_func buffer;  /* calculation buffer */
+    struct linspace grid;       /* integration grid */
+    int space_dim;              /* space dimension of the isotropic kernel */
+    int accuracy;               /* accuracy tier of kernel evaluation */
+    const struct quadrature *quad; /* quadrature rule of the moments */
+
+    int prefetch;               /* whether f also integrates the jacobian */
+    struct eval_cache cache;    /* last evaluation */
+    long calls;                 /* count of kernel integrations */
 };
 
 
+
+/*
+ * Finds a kernel by its type. Returns NULL for unknown types
+ */
+const struct kernel *get_kernel(char type);
+
+/*
+ * Returns the bound of the relative error of kernel values evaluated by
+ * blocks with the given accuracy tier
+ */
+double get_kernel_error(const struct kernel *kern, int accuracy);
+
+/*
+ * Gets an origin of integration: the left point where the kernel falls
+ * below the tail threshold. Returns NAN if the kernel has no such tail
+ */
+double get_origin(const struct kernel *kern, double a, double b);
+
+/*
+ * Empties the evaluation cache and resets the kernel integration counter
+ */
+void clear_cache(struct params *p);
+
+/*
+ * Gets excess kurtosis and dispersion of the kernel in the space dimension
+ * from its closed-form moments. Returns GSL_EDOM if the kernel has no
+ * closed form for the given parameters
+ */
+int get_exact_values(const struct kernel *kern, double a, double b,
+    int space_dim, double *k, double *d);
+
+
 /* Kurtic kernel */
 int kurtic_f(const gsl_vector *x, void *params, gsl_vector *f);
 
@@ -31,14 +121,19 @@ int kurtic_fdf(const gsl_vector *x, void *params, gsl_vector *f,
 /* Exonent polynomial kernel */
 int polyexp_f(const gsl_vector *x, void *params, gsl_vector *f);
 
-/*int kurtic_df(const gsl_vector *x, void *params, gsl_matrix *J);
+int polyexp_df(const gsl_vector *x, void *params, gsl_matrix *J);
 
-int kurtic_fdf(const gsl_vector *x, void *params, gsl_vector *f,
+int polyexp_fdf(const gsl_vector *x, void *params, gsl_vector *f,
     gsl_matrix *J);
-*/
+
 
 
 /* Roughgarden kernel */
 int rgarden_f(const gsl_vector *x, void *params, gsl_vector *f);
 
+int rgarden_df(const gsl_vector *x, void *params, gsl_matrix *J);
+
+int rgarden_fdf(const gsl_vector *x, void *params, gsl_vector *f,
+    gsl_matrix *J);
+
 #endif
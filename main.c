@@ -1,12 +1,19 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <getopt.h>
 #include <gsl/gsl_errno.h>
 #include <gsl/gsl_math.h>
 #include <gsl/gsl_multiroots.h>
 
 #include "vector.h"
 #include "solver.h"
+#include "table.h"
+#include "output.h"
+#include "telemetry.h"
 
 /*
  * Holds info about writing output data
@@ -20,27 +27,211 @@ struct output_info{
 
 
 /*
- * Initializes problem info
+ * Holds info about command line options
  */
-void make_problem_info(int argc, const char **argv, struct problem_info **p)
+struct options{
+    int accuracy;               /* kernel evaluation accuracy tier */
+    int space_dim;              /* space dimension of the kernel */
+    char quadrature;            /* quadrature rule type */
+    int thread_count;           /* count of solving threads */
+    int continuation;           /* whether to use continuation */
+    const char *table_out;      /* inverse table to build or NULL */
+    const char *table_in;       /* inverse table to look up or NULL */
+    int polish;                 /* newton steps after table lookups */
+    int binary;                 /* whether to write binary columns */
+    int resume;                 /* whether to checkpoint and resume */
+    const char *telemetry;      /* telemetry side file or NULL */
+    char telemetry_format;      /* telemetry side file format */
+    int pairs;                  /* whether to make the pair table */
+    int shard_index;            /* solved shard of the sweep */
+    int shard_count;            /* count of shards or 0 */
+    int merge;                  /* whether to merge the shards */
+};
+
+
+
+/*
+ * Count of positional arguments
+ */
+#define ARG_COUNT 10
+
+/*
+ * Count of positional arguments in the pair table mode
+ */
+#define PAIR_ARG_COUNT 12
+
+/*
+ * Codes of the options that have only the long form
+ */
+#define OPT_SHARD 256
+#define OPT_MERGE 257
+
+
+
+/*
+ * Checks whether the argument is an option, not a negative number
+ */
+int is_option(const char *arg)
+{
+    return arg[0] == '-' && arg[1] != '\0' && arg[1] != '.' &&
+        !isdigit((unsigned char)arg[1]);
+}
+
+
+
+/*
+ * Parses command line options. Returns the index of the first positional
+ * argument or -1 if options are invalid
+ */
+int parse_options(int argc, const char **argv, struct options *o)
+{
+    static const struct option long_options[] = {
+        { "shard", required_argument, NULL, OPT_SHARD },
+        { "merge", required_argument, NULL, OPT_MERGE },
+        { NULL, 0, NULL, 0 }
+    };
+    int pos;
+    int c;
+
+    o->accuracy = VM_FULL;
+    o->space_dim = 1;
+    o->quadrature = QUAD_SIMPSON;
+    o->thread_count = 1;
+    o->continuation = 0;
+    o->table_out = NULL;
+    o->table_in = NULL;
+    o->polish = 0;
+    o->binary = 0;
+    o->resume = 0;
+    o->telemetry = NULL;
+    o->telemetry_format = TELEMETRY_JSONL;
+    o->pairs = 0;
+    o->shard_index = 0;
+    o->shard_count = 0;
+    o->merge = 0;
+
+    while(optind < argc && is_option(argv[optind]) &&
+        (c = getopt_long(argc, (char * const *)argv, "a:bcD:l:n:Pq:rs:S:t:w:",
+            long_options, NULL)) != -1)
+    {
+        switch(c){
+        case 'a':
+            if(strcmp(optarg, "full") == 0){
+                o->accuracy = VM_FULL;
+            }else if(strcmp(optarg, "fast") == 0){
+                o->accuracy = VM_FAST;
+            }else if(strcmp(optarg, "single") == 0){
+                o->accuracy = VM_SINGLE;
+            }else{
+                return -1;
+            }
+            break;
+        case 'b':
+            o->binary = 1;
+            break;
+        case 'c':
+            o->continuation = 1;
+            break;
+        case 'D':
+            if(sscanf(optarg, "%d%n", &(o->space_dim), &pos) != 1 ||
+                optarg[pos] != '\0' || o->space_dim < 1)
+            {
+                return -1;
+            }
+            break;
+        case 'l':
+            o->table_in = optarg;
+            break;
+        case 'n':
+            if(sscanf(optarg, "%d", &(o->polish)) != 1 || o->polish < 0){
+                return -1;
+            }
+            break;
+        case 'P':
+            o->pairs = 1;
+            break;
+        case 'q':
+            if(strlen(optarg) != 1){
+                return -1;
+            }
+            o->quadrature = optarg[0];
+            break;
+        case 'r':
+            o->resume = 1;
+            break;
+        case 's':
+            o->telemetry = optarg;
+            o->telemetry_format = TELEMETRY_JSONL;
+            break;
+        case 'S':
+            o->telemetry = optarg;
+            o->telemetry_format = TELEMETRY_BINARY;
+            break;
+        case 't':
+            if(sscanf(optarg, "%d", &(o->thread_count)) != 1 ||
+                o->thread_count < 1)
+            {
+                return -1;
+            }
+            break;
+        case 'w':
+            o->table_out = optarg;
+            break;
+        case OPT_SHARD:
+            if(sscanf(optarg, "%d/%d%n", &(o->shard_index), &(o->shard_count),
+                &pos) != 2 || optarg[pos] != '\0' || o->shard_index < 0 ||
+                o->shard_index >= o->shard_count)
+            {
+                return -1;
+            }
+            o->merge = 0;
+            break;
+        case OPT_MERGE:
+            if(sscanf(optarg, "%d%n", &(o->shard_count), &pos) != 1 ||
+                optarg[pos] != '\0' || o->shard_count < 1)
+            {
+                return -1;
+            }
+            o->merge = 1;
+            break;
+        default:
+            return -1;
+        }
+    }
+
+    return optind;
+}
+
+
+
+/*
+ * Initializes the grid from the arguments: origin, count and last value
+ */
+void set_linspace(struct linspace *l, const char **argv)
 {
     double beg;
     int count;
     double last;
 
-    sscanf(argv[1], "%lf", &(beg));
-    sscanf(argv[2], "%d", &(count));
-    sscanf(argv[3], "%lf", &(last));
-    (*p)->k_grid.origin = beg;
-    (*p)->k_grid.count = count;
-    (*p)->k_grid.step = count > 1 ? (last - beg) / (count - 1) : 0.0;
+    sscanf(argv[0], "%lf", &(beg));
+    sscanf(argv[1], "%d", &(count));
+    sscanf(argv[2], "%lf", &(last));
+    l->origin = beg;
+    l->count = count;
+    l->step = count > 1 ? (last - beg) / (count - 1) : 0.0;
+}
+
+
+
+/*
+ * Initializes problem info
+ */
+void make_problem_info(int argc, const char **argv, struct problem_info **p)
+{
+    int count;
 
-    sscanf(argv[4], "%lf", &(beg));
-    sscanf(argv[5], "%d", &(count));
-    sscanf(argv[6], "%lf", &(last));
-    (*p)->d_grid.origin = beg;
-    (*p)->d_grid.count = count;
-    (*p)->d_grid.step = count > 1 ? (last - beg) / (count - 1) : 0.0;
+    set_linspace(&((*p)->k_grid), argv + 1);
+    set_linspace(&((*p)->d_grid), argv + 4);
 
     sscanf(argv[7], "%d", &(count));
     (*p)->space_grid.count = count;
@@ -48,16 +239,8 @@ void make_problem_info(int argc, const char **argv, struct problem_info **p)
     sscanf(argv[8], "%lf", &((*p)->eps));
     (*p)->iter_count = 100;
 
-    (*p)->kern_type = argv[9][0];
-    if((*p)->kern_type == KURTIC){
-        (*p)->f = kurtic_f;
-        (*p)->df = kurtic_df;
-        (*p)->fdf = kurtic_fdf;
-    }else if((*p)->kern_type == RGARDEN){
-        (*p)->f = rgarden_f;
-    }else if((*p)->kern_type == POLYEXP){
-        (*p)->f = polyexp_f;
-    }else{
+    if(set_kernel(*p, argv[9][0]) != 0){
+        free(*p);
         *p = NULL;
     }
 }
@@ -77,37 +260,252 @@ struct output_info make_output_info(int argc, const char **argv,
 
 
 /*
- * Writes solution
+ * Solves the problem chunk by chunk, streaming each chunk to the output
+ * as it is solved. Rows checkpointed by an interrupted run are skipped.
+ * Returns the count of kernel integrations or -1 on the output error
+ */
+long solve_stream(struct problem_info *p, struct writer *w)
+{
+    struct result res;
+    int chunk = get_chunk_rows(p);
+    int rows;
+    long calls = 0;
+
+    init_result_info(&res, p, chunk);
+
+    while(w->next_row < p->k_grid.count){
+        rows = p->k_grid.count - w->next_row < chunk
+            ? p->k_grid.count - w->next_row
+            : chunk;
+
+        res.calls = 0;
+        solve_rows(p, w->next_row, rows, &res);
+        calls += res.calls;
+
+        if(writer_put(w, &res, rows) != 0){
+            calls = -1;
+            break;
+        }
+    }
+
+    free(res.a.storage);
+    free(res.b.storage);
+
+    return calls;
+}
+
+
+
+/*
+ * Sets the solving options of the problem and allocates the quadrature
+ * rule and the inverse table. Returns 0 on success, otherwise prints the
+ * error
+ */
+int init_solving(struct problem_info *p, const struct options *o,
+    struct table **table)
+{
+    p->row_first = 0;
+    p->row_stride = 1;
+    p->space_dim = o->space_dim;
+    p->accuracy = o->accuracy;
+    p->thread_count = o->thread_count;
+    p->continuation = o->continuation;
+    p->polish = o->polish;
+    p->table = NULL;
+    p->telemetry = NULL;
+    *table = NULL;
+
+    if(p->space_dim != 1 && (o->table_in != NULL || o->table_out != NULL)){
+        fprintf(stderr, "### Tables hold one-dimensional kernels only!\n");
+        return 1;
+    }
+
+    p->quad = quad_alloc(o->quadrature, p->space_grid.count,
+        QUAD_TOL * p->eps);
+    if(p->quad == NULL){
+        fprintf(stderr, "### Invalid quadrature!\n");
+        return 1;
+    }
+
+    if(o->table_in != NULL){
+        *table = table_open(o->table_in);
+        if(*table == NULL || (*table)->header->kern_type != p->kern_type){
+            fprintf(stderr, "### Invalid table!\n");
+            table_close(*table);
+            quad_free(p->quad);
+            return 1;
+        }
+        p->table = *table;
+    }
+
+    return 0;
+}
+
+
+
+/*
+ * Parses the list of numbers separated by spaces or commas. Returns the
+ * count of numbers or -1 if the list is invalid
+ */
+int parse_list(const char *s, double **values)
+{
+    int count = 0;
+    char *end;
+
+    *values = malloc(sizeof(double) * (strlen(s) / 2 + 1));
+    while(*s != '\0'){
+        while(*s == ' ' || *s == ','){
+            s++;
+        }
+        if(*s == '\0'){
+            break;
+        }
+
+        (*values)[count++] = strtod(s, &end);
+        if(end == s){
+            return -1;
+        }
+        s = end;
+    }
+
+    return count;
+}
+
+
+
+/*
+ * Solves the side of the pair table row by row. Returns the count of
+ * kernel integrations
  */
-void print(struct result res, struct output_info oinf)
+long solve_side(struct problem_info *p, struct pair_side *side)
 {
-    FILE *out = fopen(oinf.file_name, "w");
+    struct result res;
+    int count = side->d_grid.count;
+    long calls = 0;
     int i;
-    int j;
-    int index;
-    double k = oinf.k_grid.origin;
-    double d = oinf.d_grid.origin;
 
-    for(i = 0; i < oinf.k_grid.count; i++){
-        index = i * oinf.d_grid.count;
-        d = oinf.d_grid.origin;
-        for(j = 0; j < oinf.d_grid.count; j++){
-            fprintf(
-                out,
-                "%lf %lf %lf %lf\n",
-                k,
-                d,
-                res.a.storage[index + j],
-                res.b.storage[index + j]
-            );
+    p->d_grid = side->d_grid;
+    p->k_grid.count = 1;
+    p->k_grid.step = 0.0;
+    side->a = malloc(sizeof(double) * side->k_count * count);
+    side->b = malloc(sizeof(double) * side->k_count * count);
+    init_result_info(&res, p, 1);
+
+    for(i = 0; i < side->k_count; i++){
+        p->k_grid.origin = side->k[i];
+        res.calls = 0;
+        solve_rows(p, 0, 1, &res);
+        calls += res.calls;
+
+        memcpy(side->a + i * count, res.a.storage, sizeof(double) * count);
+        memcpy(side->b + i * count, res.b.storage, sizeof(double) * count);
+    }
+
+    free(res.a.storage);
+    free(res.b.storage);
+
+    return calls;
+}
+
+
+
+/*
+ * Checks whether the sides are made of the same arguments
+ */
+int is_same_side(const struct pair_side *m, const struct pair_side *w)
+{
+    return m->k_count == w->k_count &&
+        memcmp(m->k, w->k, sizeof(double) * m->k_count) == 0 &&
+        m->d_grid.count == w->d_grid.count &&
+        m->d_grid.origin == w->d_grid.origin &&
+        m->d_grid.step == w->d_grid.step;
+}
+
+
+
+/*
+ * Makes the table of the m(x) and w(x) parameter pairs. Positional
+ * arguments: m excess list, m deviation origin, count and last value, the
+ * same for w, space count, precision, kernel and output file. The m
+ * solutions are reused if the w arguments are the same
+ */
+int make_pairs(const char **argv, const struct options *o)
+{
+    struct problem_info p;
+    struct pair_side m;
+    struct pair_side w;
+    struct table *table;
+    long calls;
+    int status = 0;
+
+    memset(&m, 0, sizeof(m));
+    memset(&w, 0, sizeof(w));
+    m.k_count = parse_list(argv[1], &(m.k));
+    set_linspace(&(m.d_grid), argv + 2);
+    w.k_count = parse_list(argv[5], &(w.k));
+    set_linspace(&(w.d_grid), argv + 6);
+
+    sscanf(argv[9], "%d", &(p.space_grid.count));
+    sscanf(argv[10], "%lf", &(p.eps));
+    p.iter_count = 100;
+
+    if(m.k_count < 1 || w.k_count < 1 || m.d_grid.count < 1 ||
+        w.d_grid.count < 1 || set_kernel(&p, argv[11][0]) != 0)
+    {
+        fprintf(stderr, "### Invalid arguments!\n");
+        free(m.k);
+        free(w.k);
+        return 1;
+    }
+
+    if(init_solving(&p, o, &table) != 0){
+        free(m.k);
+        free(w.k);
+        return 1;
+    }
+
+    if(o->telemetry != NULL){
+        p.telemetry = telemetry_open(o->telemetry, o->telemetry_format);
+        if(p.telemetry == NULL){
+            fprintf(stderr, "### Cannot open telemetry!\n");
+            status = 1;
+        }
+    }
+
+    if(status == 0){
+        calls = solve_side(&p, &m);
+        if(is_same_side(&m, &w)){
+            w.a = m.a;
+            w.b = m.b;
+        }else{
+            calls += solve_side(&p, &w);
+        }
 
-            d += oinf.d_grid.step;
+        if(write_pairs(argv[12], &p, &m, &w, o->binary) != 0){
+            fprintf(stderr, "### Cannot write output!\n");
+            status = 1;
+        }else{
+            printf("Kernel integrations: %ld\n", calls);
         }
 
-        k += oinf.k_grid.step;
+        if(telemetry_close(p.telemetry, stdout) != 0){
+            fprintf(stderr, "### Cannot write telemetry!\n");
+            status = 1;
+        }
     }
 
-    fclose(out);
+    if(w.a != m.a){
+        free(w.a);
+        free(w.b);
+    }
+    free(m.a);
+    free(m.b);
+    free(m.k);
+    free(w.k);
+    table_close(table);
+    quad_free(p.quad);
+
+    return status;
 }
 
 
@@ -141,27 +539,189 @@ void print_given_info(struct problem_info *p, struct output_info o)
 
 int main(int argc, const char **argv)
 {
-    struct problem_info *prinf = malloc(sizeof(struct problem_info));
+    struct problem_info *prinf;
     struct output_info oinf;
+    struct options opts;
     struct result res;
-    
+    struct writer writer;
+    struct table *table = NULL;
+    struct table_node *nodes;
+    struct problem_info sweep;
+    char *shard_name = NULL;
+    char *journal_name;
+    long calls;
+    int status = 0;
+    int first = parse_options(argc, argv, &opts);
+
+    if(first >= 0 && opts.pairs){
+        if(argc - first < PAIR_ARG_COUNT || opts.table_out != NULL ||
+            opts.resume || opts.shard_count > 0)
+        {
+            fprintf(stderr, "### Invalid arguments!\n");
+            return 1;
+        }
+
+        return make_pairs(argv + first - 1, &opts);
+    }
+
+    if(first < 0 || argc - first < ARG_COUNT ||
+        (opts.merge && (opts.table_out != NULL || opts.resume)))
+    {
+        fprintf(stderr, "### Invalid arguments!\n");
+        return 1;
+    }
+
+    /* a shard point has another grid neighbour than in the sweep */
+    if(opts.continuation && opts.shard_count > 0){
+        fprintf(stderr, "### Continuation cannot be sharded!\n");
+        return 1;
+    }
+
+    /* positional arguments are shifted to start from argv[1] */
+    argv += first - 1;
+    argc -= first - 1;
+
+    prinf = malloc(sizeof(struct problem_info));
     make_problem_info(argc, argv, &prinf);
     if(prinf == NULL){
         fprintf(stderr, "### Invalid arguments!\n");
         return 1;
     }
 
+    if(init_solving(prinf, &opts, &table) != 0){
+        free(prinf);
+        return 1;
+    }
+
+    if(opts.table_out != NULL &&
+        (prinf->k_grid.count < 2 || prinf->d_grid.count < 2))
+    {
+        fprintf(stderr, "### Table needs at least two nodes per axis!\n");
+        table_close(table);
+        quad_free(prinf->quad);
+        free(prinf);
+        return 1;
+    }
+
+    if(opts.table_out != NULL && (opts.resume || opts.shard_count > 0)){
+        fprintf(stderr, "### Table building cannot be resumed or sharded!\n");
+        table_close(table);
+        quad_free(prinf->quad);
+        free(prinf);
+        return 1;
+    }
+
 #   ifdef DEBUG
     print_given_info(prinf, oinf);
 #   endif
     
     oinf = make_output_info(argc, argv, prinf);
-    res = solve(prinf);
-    print(res, oinf);
+    if(opts.merge){
+        status = merge_shards(prinf, opts.shard_count, opts.binary,
+            oinf.file_name);
+        if(status > 0){
+            fprintf(stderr, "### Shard %d is missing or incomplete!\n",
+                status - 1);
+        }else if(status < 0){
+            fprintf(stderr, "### Cannot write output!\n");
+        }
+        status = status != 0;
+        table_close(table);
+        quad_free(prinf->quad);
+        free(prinf);
+        return status;
+    }
 
-    free(res.a.storage);
-    free(res.b.storage);
+    /* the shard is solved as the sweep of its rows */
+    if(opts.shard_count > 0){
+        sweep = *prinf;
+        shard_name = get_shard_name(oinf.file_name, opts.shard_index);
+        journal_name = shard_name != NULL
+            ? get_journal_name(shard_name)
+            : NULL;
+        if(journal_name == NULL || get_shard_problem(&sweep,
+            opts.shard_index, opts.shard_count, get_accuracy(&sweep),
+            prinf) != 0)
+        {
+            fprintf(stderr, "### Invalid shard!\n");
+            free(journal_name);
+            free(shard_name);
+            table_close(table);
+            quad_free(prinf->quad);
+            free(prinf);
+            return 1;
+        }
+
+        if(!opts.resume){
+            remove(journal_name);
+        }
+        free(journal_name);
+        oinf.file_name = shard_name;
+    }
+
+    if(writer_open(&writer, oinf.file_name, prinf, opts.binary,
+        opts.resume || opts.shard_count > 0) != 0)
+    {
+        fprintf(stderr, "### Cannot open output!\n");
+        free(shard_name);
+        table_close(table);
+        quad_free(prinf->quad);
+        free(prinf);
+        return 1;
+    }
+
+    prinf->telemetry = NULL;
+    if(opts.telemetry != NULL){
+        prinf->telemetry = telemetry_open(opts.telemetry,
+            opts.telemetry_format);
+        if(prinf->telemetry == NULL){
+            fprintf(stderr, "### Cannot open telemetry!\n");
+            writer_close(&writer);
+            free(shard_name);
+            table_close(table);
+            quad_free(prinf->quad);
+            free(prinf);
+            return 1;
+        }
+    }
+
+    if(opts.table_out == NULL){
+        calls = solve_stream(prinf, &writer);
+    }else{
+        /* the table is made of the whole solution */
+        res = solve(prinf);
+        calls = writer_put(&writer, &res, prinf->k_grid.count) == 0
+            ? res.calls
+            : -1;
+
+        nodes = make_table_nodes(prinf, &res);
+        if(nodes == NULL || table_write(opts.table_out, prinf->kern_type,
+            &(prinf->k_grid), &(prinf->d_grid), nodes) != 0)
+        {
+            fprintf(stderr, "### Cannot write table!\n");
+            status = 1;
+        }
+        free(nodes);
+        free(res.a.storage);
+        free(res.b.storage);
+    }
+
+    if(writer_close(&writer) != 0 || calls < 0){
+        fprintf(stderr, "### Cannot write output!\n");
+        status = 1;
+    }else{
+        printf("Kernel integrations: %ld\n", calls);
+    }
+
+    if(telemetry_close(prinf->telemetry, stdout) != 0){
+        fprintf(stderr, "### Cannot write telemetry!\n");
+        status = 1;
+    }
+
+    free(shard_name);
+    table_close(table);
+    quad_free(prinf->quad);
     free(prinf);
 
-    return 0;
+    return status;
 }
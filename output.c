@@ -0,0 +1,811 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "output.h"
+
+/*
+ * Count of pair table rows formatted at once
+ */
+#define PAIRS_BLOCK 65536
+
+/*
+ * Stores numbers in little endian regardless of the host byte order
+ */
+static unsigned char *put_u32(unsigned char *buf, uint32_t v)
+{
+    int i;
+
+    for(i = 0; i < 4; i++){
+        buf[i] = (unsigned char)(v >> (8 * i));
+    }
+
+    return buf + 4;
+}
+
+static unsigned char *put_u64(unsigned char *buf, uint64_t v)
+{
+    int i;
+
+    for(i = 0; i < 8; i++){
+        buf[i] = (unsigned char)(v >> (8 * i));
+    }
+
+    return buf + 8;
+}
+
+static unsigned char *put_f64(unsigned char *buf, double v)
+{
+    uint64_t bits;
+
+    memcpy(&bits, &v, sizeof(bits));
+
+    return put_u64(buf, bits);
+}
+
+/*
+ * Loads numbers stored by put_u64 and put_f64
+ */
+static uint64_t get_u64(const unsigned char *buf)
+{
+    uint64_t v = 0;
+    int i;
+
+    for(i = 7; i >= 0; i--){
+        v = (v << 8) | buf[i];
+    }
+
+    return v;
+}
+
+static double get_f64(const unsigned char *buf)
+{
+    uint64_t bits = get_u64(buf);
+    double v;
+
+    memcpy(&v, &bits, sizeof(v));
+
+    return v;
+}
+
+
+
+/*
+ * Serializes the header field by field, without the host struct padding
+ */
+static unsigned char *put_header(unsigned char *buf,
+    const struct output_header *h)
+{
+    buf = put_u32(buf, h->magic);
+    buf = put_u32(buf, h->version);
+    memcpy(buf, &(h->kern_type), 1);
+    memcpy(buf + 1, h->reserved, 3);
+    buf += 4;
+    buf = put_u32(buf, (uint32_t)h->space_count);
+    buf = put_u32(buf, (uint32_t)h->k_count);
+    buf = put_u32(buf, (uint32_t)h->d_count);
+    buf = put_f64(buf, h->k_origin);
+    buf = put_f64(buf, h->k_step);
+    buf = put_f64(buf, h->d_origin);
+    buf = put_f64(buf, h->d_step);
+    buf = put_f64(buf, h->eps);
+    buf = put_u64(buf, h->count);
+
+    return buf;
+}
+
+
+
+/*
+ * Formats the journal header that identifies the sweep and the way its
+ * points are solved, so a journal of another sweep is never resumed or
+ * merged
+ */
+static void get_journal_header(const struct problem_info *p, int binary,
+    char *buf, size_t size)
+{
+    snprintf(
+        buf,
+        size,
+        "excess journal %d %c %c %d %d %d %.17g %.17g %d %d %d %.17g %.17g "
+        "%.17g %d %d %d %d %d\n",
+        JOURNAL_VERSION,
+        p->kern_type,
+        p->quad->type,
+        p->space_grid.count,
+        p->space_dim,
+        p->k_grid.count,
+        p->k_grid.origin,
+        p->k_grid.step,
+        p->row_first,
+        p->row_stride,
+        p->d_grid.count,
+        p->d_grid.origin,
+        p->d_grid.step,
+        p->eps,
+        p->accuracy,
+        p->continuation,
+        p->table != NULL,
+        p->polish,
+        binary
+    );
+}
+
+
+
+/*
+ * Reads the last checkpoint of the journal. A torn last line is ignored.
+ * Returns 0 on success, or 1 if the journal belongs to another sweep
+ */
+static int read_journal(FILE *journal, const struct problem_info *p,
+    int binary, int *next_row, long *offset)
+{
+    char expected[JOURNAL_LINE];
+    char line[JOURNAL_LINE];
+    int row;
+    long pos;
+
+    get_journal_header(p, binary, expected, sizeof(expected));
+    if(fgets(line, sizeof(line), journal) == NULL ||
+        strcmp(line, expected) != 0)
+    {
+        return 1;
+    }
+
+    while(fgets(line, sizeof(line), journal) != NULL){
+        if(strchr(line, '\n') == NULL ||
+            sscanf(line, "%d %ld", &row, &pos) != 2 ||
+            row <= *next_row || row > p->k_grid.count || pos < 0)
+        {
+            break;
+        }
+
+        *next_row = row;
+        *offset = pos;
+    }
+
+    return 0;
+}
+
+
+
+/*
+ * Writes the binary header and sizes the file to hold all the columns
+ */
+static int init_binary(FILE *out, const struct problem_info *p)
+{
+    struct output_header h;
+    unsigned char buf[OUTPUT_HEADER_SIZE];
+    size_t count = (size_t)p->k_grid.count * p->d_grid.count;
+
+    memset(&h, 0, sizeof(h));
+    h.magic = OUTPUT_MAGIC;
+    h.version = OUTPUT_VERSION;
+    h.kern_type = p->kern_type;
+    h.space_count = p->space_grid.count;
+    h.k_count = p->k_grid.count;
+    h.d_count = p->d_grid.count;
+    h.k_origin = get_row_k(p, 0);
+    h.k_step = p->row_stride * p->k_grid.step;
+    h.d_origin = p->d_grid.origin;
+    h.d_step = p->d_grid.step;
+    h.eps = p->eps;
+    h.count = count;
+
+    put_header(buf, &h);
+    if(fwrite(buf, 1, sizeof(buf), out) != sizeof(buf) || fflush(out) != 0){
+        return 1;
+    }
+
+    return ftruncate(fileno(out),
+        OUTPUT_HEADER_SIZE + 4 * count * sizeof(double)) != 0;
+}
+
+
+
+/*
+ * Reopens the result file of the interrupted sweep at the checkpoint
+ */
+static FILE *reopen_output(const char *file_name,
+    const struct problem_info *p, int binary, long offset)
+{
+    FILE *out = fopen(file_name, "r+b");
+    size_t count = (size_t)p->k_grid.count * p->d_grid.count;
+    long size;
+
+    if(out == NULL){
+        return NULL;
+    }
+
+    if(binary){
+        size = OUTPUT_HEADER_SIZE + 4 * count * sizeof(double);
+        if(fseek(out, 0, SEEK_END) != 0 || ftell(out) != size){
+            fclose(out);
+            return NULL;
+        }
+    }else if(ftruncate(fileno(out), offset) != 0 ||
+        fseek(out, offset, SEEK_SET) != 0)
+    {
+        fclose(out);
+        return NULL;
+    }
+
+    return out;
+}
+
+
+
+int writer_open(struct writer *w, const char *file_name,
+    const struct problem_info *p, int binary, int journal)
+{
+    char header[JOURNAL_LINE];
+    char *name = NULL;
+    FILE *old;
+    long offset = 0;
+    int status = 0;
+
+    w->p = p;
+    w->out = NULL;
+    w->journal = NULL;
+    w->binary = binary;
+    w->next_row = 0;
+
+    if(journal){
+        name = get_journal_name(file_name);
+        if(name == NULL){
+            return 1;
+        }
+
+        old = fopen(name, "r");
+        if(old != NULL){
+            status = read_journal(old, p, binary, &(w->next_row), &offset);
+            fclose(old);
+        }
+
+        if(status == 0 && w->next_row > 0){
+            w->out = reopen_output(file_name, p, binary, offset);
+            w->journal = fopen(name, "a");
+            status = w->out == NULL || w->journal == NULL;
+        }
+    }
+
+    if(status == 0 && w->out == NULL){
+        w->out = fopen(file_name, "wb");
+        status = w->out == NULL || (binary && init_binary(w->out, p) != 0);
+
+        if(status == 0 && journal){
+            w->journal = fopen(name, "w");
+            get_journal_header(p, binary, header, sizeof(header));
+            status = w->journal == NULL || fputs(header, w->journal) < 0 ||
+                fflush(w->journal) != 0;
+        }
+    }
+
+    free(name);
+
+    if(status != 0){
+        writer_close(w);
+    }
+
+    return status;
+}
+
+
+
+/*
+ * Writes the rows of the chunk as text lines
+ */
+static int put_text(struct writer *w, const struct result *res, int rows)
+{
+    const struct problem_info *p = w->p;
+    int count = rows * p->d_grid.count;
+    int index;
+    int i;
+    int j;
+
+    for(index = 0; index < count; index++){
+        i = w->next_row + index / p->d_grid.count;
+        j = index % p->d_grid.count;
+        if(fprintf(
+            w->out,
+            "%lf %lf %lf %lf\n",
+            get_row_k(p, i),
+            p->d_grid.origin + j * p->d_grid.step,
+            res->a.storage[index],
+            res->b.storage[index]
+        ) < 0){
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+
+/*
+ * Writes the rows of the chunk into their places of the binary columns
+ */
+static int put_columns(struct writer *w, const struct result *res, int rows)
+{
+    const struct problem_info *p = w->p;
+    size_t total = (size_t)p->k_grid.count * p->d_grid.count;
+    size_t first = (size_t)w->next_row * p->d_grid.count;
+    size_t count = (size_t)rows * p->d_grid.count;
+    unsigned char *buf = malloc(8 * count);
+    double v;
+    size_t index;
+    int col;
+    int status = 0;
+
+    if(buf == NULL){
+        return 1;
+    }
+
+    for(col = 0; col < 4 && status == 0; col++){
+        for(index = 0; index < count; index++){
+            if(col == 0){
+                v = get_row_k(p, (int)((first + index) / p->d_grid.count));
+            }else if(col == 1){
+                v = p->d_grid.origin +
+                    (int)(index % p->d_grid.count) * p->d_grid.step;
+            }else{
+                v = (col == 2 ? res->a.storage : res->b.storage)[index];
+            }
+            put_f64(buf + 8 * index, v);
+        }
+
+        if(fseek(w->out, OUTPUT_HEADER_SIZE + 8 * (col * total + first),
+                SEEK_SET) != 0 ||
+            fwrite(buf, 8, count, w->out) != count)
+        {
+            status = 1;
+        }
+    }
+
+    free(buf);
+
+    return status;
+}
+
+
+
+int writer_put(struct writer *w, const struct result *res, int rows)
+{
+    int status = w->binary
+        ? put_columns(w, res, rows)
+        : put_text(w, res, rows);
+
+    w->next_row += rows;
+
+    if(status != 0 || w->journal == NULL){
+        return status;
+    }
+
+    /* the checkpoint must not get ahead of the data on the disk */
+    if(fflush(w->out) != 0 || fsync(fileno(w->out)) != 0 ||
+        fprintf(w->journal, "%d %ld\n", w->next_row, ftell(w->out)) < 0 ||
+        fflush(w->journal) != 0 || fsync(fileno(w->journal)) != 0)
+    {
+        return 1;
+    }
+
+    return 0;
+}
+
+
+
+int writer_close(struct writer *w)
+{
+    int status = 0;
+
+    if(w->out != NULL && fclose(w->out) != 0){
+        status = 1;
+    }
+
+    if(w->journal != NULL && fclose(w->journal) != 0){
+        status = 1;
+    }
+
+    w->out = NULL;
+    w->journal = NULL;
+
+    return status;
+}
+
+
+
+char *get_journal_name(const char *file_name)
+{
+    char *name = malloc(strlen(file_name) + sizeof(JOURNAL_SUFFIX));
+
+    if(name != NULL){
+        strcpy(name, file_name);
+        strcat(name, JOURNAL_SUFFIX);
+    }
+
+    return name;
+}
+
+
+
+char *get_shard_name(const char *file_name, int index)
+{
+    size_t size = strlen(file_name) + sizeof(SHARD_SUFFIX) + 16;
+    char *name = malloc(size);
+
+    if(name != NULL){
+        snprintf(name, size, "%s%s%d", file_name, SHARD_SUFFIX, index);
+    }
+
+    return name;
+}
+
+
+
+int get_shard_problem(const struct problem_info *p, int index, int count,
+    int accuracy, struct problem_info *shard)
+{
+    *shard = *p;
+    shard->accuracy = accuracy;
+    shard->row_first = p->row_first + index * p->row_stride;
+    shard->row_stride = count * p->row_stride;
+    shard->k_grid.count = (p->k_grid.count - index + count - 1) / count;
+
+    return shard->k_grid.count < 1;
+}
+
+
+
+int reader_open(struct reader *r, const char *file_name,
+    const struct problem_info *p, int binary)
+{
+    char *name = get_journal_name(file_name);
+    size_t count = (size_t)p->k_grid.count * p->d_grid.count;
+    FILE *journal;
+    long offset = 0;
+    long size;
+    int status;
+
+    r->p = p;
+    r->in = NULL;
+    r->binary = binary;
+    r->next_row = 0;
+
+    if(name == NULL){
+        return 1;
+    }
+
+    journal = fopen(name, "r");
+    free(name);
+    if(journal == NULL){
+        return 1;
+    }
+
+    status = read_journal(journal, p, binary, &(r->next_row), &offset);
+    fclose(journal);
+    if(status != 0 || r->next_row != p->k_grid.count){
+        return 1;
+    }
+
+    /* data past the last checkpoint means the file was changed */
+    size = binary ? OUTPUT_HEADER_SIZE + 4 * count * sizeof(double) : offset;
+    r->next_row = 0;
+    r->in = fopen(file_name, "rb");
+    if(r->in == NULL || fseek(r->in, 0, SEEK_END) != 0 ||
+        ftell(r->in) != size || fseek(r->in, 0, SEEK_SET) != 0)
+    {
+        reader_close(r);
+        return 1;
+    }
+
+    return 0;
+}
+
+
+
+/*
+ * Reads the solution of the rows from the text lines
+ */
+static int get_text(struct reader *r, struct result *res, int rows)
+{
+    int count = rows * r->p->d_grid.count;
+    double k;
+    double d;
+    int index;
+
+    for(index = 0; index < count; index++){
+        if(fscanf(r->in, "%lf %lf %lf %lf", &k, &d, res->a.storage + index,
+            res->b.storage + index) != 4)
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+
+/*
+ * Reads the solution of the rows from the binary columns
+ */
+static int get_columns(struct reader *r, struct result *res, int rows)
+{
+    const struct problem_info *p = r->p;
+    size_t total = (size_t)p->k_grid.count * p->d_grid.count;
+    size_t first = (size_t)r->next_row * p->d_grid.count;
+    size_t count = (size_t)rows * p->d_grid.count;
+    unsigned char *buf = malloc(8 * count);
+    double *v;
+    size_t index;
+    int col;
+    int status = 0;
+
+    if(buf == NULL){
+        return 1;
+    }
+
+    for(col = 2; col < 4 && status == 0; col++){
+        if(fseek(r->in, OUTPUT_HEADER_SIZE + 8 * (col * total + first),
+                SEEK_SET) != 0 ||
+            fread(buf, 8, count, r->in) != count)
+        {
+            status = 1;
+            break;
+        }
+
+        v = col == 2 ? res->a.storage : res->b.storage;
+        for(index = 0; index < count; index++){
+            v[index] = get_f64(buf + 8 * index);
+        }
+    }
+
+    free(buf);
+
+    return status;
+}
+
+
+
+int reader_get(struct reader *r, struct result *res, int rows)
+{
+    int status;
+
+    if(r->next_row + rows > r->p->k_grid.count){
+        return 1;
+    }
+
+    status = r->binary ? get_columns(r, res, rows) : get_text(r, res, rows);
+    r->next_row += rows;
+
+    return status;
+}
+
+
+
+void reader_close(struct reader *r)
+{
+    if(r->in != NULL){
+        fclose(r->in);
+    }
+
+    r->in = NULL;
+}
+
+
+
+int merge_shards(const struct problem_info *p, int count, int binary,
+    const char *file_name)
+{
+    struct problem_info *shards = malloc(sizeof(struct problem_info) * count);
+    struct reader *readers = calloc(count, sizeof(struct reader));
+    int chunk = get_chunk_rows(p);
+    int accuracy = get_accuracy(p);
+    struct writer writer;
+    struct result res;
+    struct result row;
+    char *name;
+    int rows;
+    int i;
+    int j;
+    int status = 0;
+
+    if(shards == NULL || readers == NULL){
+        free(shards);
+        free(readers);
+        return -1;
+    }
+
+    for(i = 0; i < count && status == 0; i++){
+        name = get_shard_name(file_name, i);
+        if(name == NULL ||
+            get_shard_problem(p, i, count, accuracy, shards + i) != 0 ||
+            reader_open(readers + i, name, shards + i, binary) != 0)
+        {
+            status = i + 1;
+        }
+        free(name);
+    }
+
+    if(status == 0 && writer_open(&writer, file_name, p, binary, 0) != 0){
+        status = -1;
+    }
+
+    if(status == 0){
+        init_result_info(&res, p, chunk);
+        row = res;
+
+        /* row i of the sweep is row i / count of shard i % count */
+        while(status == 0 && writer.next_row < p->k_grid.count){
+            rows = p->k_grid.count - writer.next_row < chunk
+                ? p->k_grid.count - writer.next_row
+                : chunk;
+
+            for(j = 0; j < rows && status == 0; j++){
+                i = (writer.next_row + j) % count;
+                row.a.storage = res.a.storage + j * p->d_grid.count;
+                row.b.storage = res.b.storage + j * p->d_grid.count;
+                if(reader_get(readers + i, &row, 1) != 0){
+                    status = i + 1;
+                }
+            }
+
+            if(status == 0 && writer_put(&writer, &res, rows) != 0){
+                status = -1;
+            }
+        }
+
+        if(writer_close(&writer) != 0 && status == 0){
+            status = -1;
+        }
+
+        free(res.a.storage);
+        free(res.b.storage);
+    }
+
+    for(i = 0; i < count; i++){
+        reader_close(readers + i);
+    }
+    free(readers);
+    free(shards);
+
+    return status;
+}
+
+
+
+/*
+ * Gets the value of the column of the pair table row
+ */
+static double get_pair_value(const struct pair_side *m,
+    const struct pair_side *w, size_t row, int col)
+{
+    size_t dw = row % w->d_grid.count;
+    size_t dm = row / w->d_grid.count % m->d_grid.count;
+    size_t kw = row / w->d_grid.count / m->d_grid.count % w->k_count;
+    size_t km = row / w->d_grid.count / m->d_grid.count / w->k_count;
+    size_t im = km * m->d_grid.count + dm;
+    size_t iw = kw * w->d_grid.count + dw;
+
+    switch(col){
+    case 0:
+        return m->k[km];
+    case 1:
+        return w->k[kw];
+    case 2:
+        return m->d_grid.origin + (int)dm * m->d_grid.step;
+    case 3:
+        return w->d_grid.origin + (int)dw * w->d_grid.step;
+    case 4:
+        return m->a[im];
+    case 5:
+        return m->b[im];
+    case 6:
+        return w->a[iw];
+    default:
+        return w->b[iw];
+    }
+}
+
+
+
+/*
+ * Writes the binary pair table column by column through a buffer of
+ * PAIRS_BLOCK rows
+ */
+static int put_pair_columns(FILE *out, const struct problem_info *p,
+    const struct pair_side *m, const struct pair_side *w, size_t count)
+{
+    struct pairs_header h;
+    unsigned char *buf = malloc(8 * PAIRS_BLOCK);
+    size_t row;
+    size_t n;
+    size_t i;
+    int col;
+    int status = 0;
+
+    if(buf == NULL){
+        return 1;
+    }
+
+    memset(&h, 0, sizeof(h));
+    h.magic = PAIRS_MAGIC;
+    h.version = PAIRS_VERSION;
+    h.kern_type = p->kern_type;
+    h.space_count = p->space_grid.count;
+    h.eps = p->eps;
+    h.count = count;
+
+    put_u32(buf, h.magic);
+    put_u32(buf + 4, h.version);
+    memcpy(buf + 8, &(h.kern_type), 1);
+    memcpy(buf + 9, h.reserved, 3);
+    put_u32(buf + 12, (uint32_t)h.space_count);
+    put_f64(buf + 16, h.eps);
+    put_u64(buf + 24, h.count);
+    if(fwrite(buf, 1, PAIRS_HEADER_SIZE, out) != PAIRS_HEADER_SIZE){
+        status = 1;
+    }
+
+    for(col = 0; col < 8 && status == 0; col++){
+        for(row = 0; row < count && status == 0; row += n){
+            n = count - row < PAIRS_BLOCK ? count - row : PAIRS_BLOCK;
+            for(i = 0; i < n; i++){
+                put_f64(buf + 8 * i, get_pair_value(m, w, row + i, col));
+            }
+
+            if(fwrite(buf, 8, n, out) != n){
+                status = 1;
+            }
+        }
+    }
+
+    free(buf);
+
+    return status;
+}
+
+
+
+int write_pairs(const char *file_name, const struct problem_info *p,
+    const struct pair_side *m, const struct pair_side *w, int binary)
+{
+    size_t count = (size_t)m->k_count * w->k_count *
+        m->d_grid.count * w->d_grid.count;
+    FILE *out = fopen(file_name, binary ? "wb" : "w");
+    size_t row;
+    int status = 0;
+
+    if(out == NULL){
+        return 1;
+    }
+
+    setvbuf(out, NULL, _IOFBF, 8 * PAIRS_BLOCK);
+
+    if(binary){
+        status = put_pair_columns(out, p, m, w, count);
+    }else{
+        for(row = 0; row < count && status == 0; row++){
+            status = fprintf(
+                out,
+                "%lf %lf %lf %lf %lf %lf %lf %lf\n",
+                get_pair_value(m, w, row, 0),
+                get_pair_value(m, w, row, 1),
+                get_pair_value(m, w, row, 2),
+                get_pair_value(m, w, row, 3),
+                get_pair_value(m, w, row, 4),
+                get_pair_value(m, w, row, 5),
+                get_pair_value(m, w, row, 6),
+                get_pair_value(m, w, row, 7)
+            ) < 0;
+        }
+    }
+
+    if(fclose(out) != 0){
+        status = 1;
+    }
+
+    return status;
+}
@@ -0,0 +1,197 @@
+#ifndef OUTPUT_MODULE_H
+#define OUTPUT_MODULE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "solver.h"
+
+/*
+ * Binary result file identification
+ */
+#define OUTPUT_MAGIC 0x5358454bu    /* "KEXS" in little endian */
+#define OUTPUT_VERSION 1
+
+/*
+ * Binary result header. It is followed by the columns k, d, a and b of
+ * count doubles each, so the file maps directly to an array, e.g.
+ * numpy.memmap(name, "<f8", "r", 72, (4, count)). All numbers are little
+ * endian
+ */
+struct output_header{
+    uint32_t magic;
+    uint32_t version;
+    char kern_type;                 /* kernel type */
+    char reserved[3];
+    int32_t space_count;            /* space node count */
+    int32_t k_count;                /* excess kurtosis grid */
+    int32_t d_count;                /* standard deviation grid */
+    double k_origin;
+    double k_step;
+    double d_origin;
+    double d_step;
+    double eps;                     /* solver precision */
+    uint64_t count;                 /* row count */
+};
+
+#define OUTPUT_HEADER_SIZE 72
+
+
+
+/*
+ * Binary pair table identification
+ */
+#define PAIRS_MAGIC 0x5058454bu     /* "KEXP" in little endian */
+#define PAIRS_VERSION 1
+
+/*
+ * Binary pair table header. It is followed by the columns km, kw, dm, dw,
+ * am, bm, aw and bw of count doubles each. All numbers are little endian
+ */
+struct pairs_header{
+    uint32_t magic;
+    uint32_t version;
+    char kern_type;                 /* kernel type */
+    char reserved[3];
+    int32_t space_count;            /* space node count */
+    double eps;                     /* solver precision */
+    uint64_t count;                 /* row count */
+};
+
+#define PAIRS_HEADER_SIZE 32
+
+/*
+ * Solutions of one side, m(x) or w(x), of the pair table
+ */
+struct pair_side{
+    int k_count;                    /* count of excess values */
+    double *k;                      /* excess values */
+    struct linspace d_grid;         /* standard deviation grid */
+    double *a;                      /* solutions by excess, then deviation */
+    double *b;
+};
+
+/*
+ * Checkpoint journal of the streamed result file, named by the suffix
+ * appended to the result file name. The journal holds the line of
+ * get_journal_header, then a line "<next row> <file offset>" per written
+ * chunk
+ */
+#define JOURNAL_SUFFIX ".journal"
+#define JOURNAL_VERSION 4
+#define JOURNAL_LINE 256
+
+/*
+ * Shard files of a sharded sweep are named by the suffix and the shard
+ * index appended to the result file name. Shard i of N solves the grid
+ * rows i, i + N, i + 2N, ..., so every shard gets a similar share of hard
+ * rows. Shards are always journaled, so the merge can check that they are
+ * complete
+ */
+#define SHARD_SUFFIX ".shard"
+
+/*
+ * Streams the solution to the result file chunk by chunk. With the
+ * journal, every written chunk is checkpointed, so a restarted sweep
+ * resumes from the first unwritten row
+ */
+struct writer{
+    const struct problem_info *p;   /* solved problem */
+    FILE *out;                      /* result file */
+    FILE *journal;                  /* checkpoint journal or NULL */
+    int binary;                     /* whether to write binary columns */
+    int next_row;                   /* first grid row not written yet */
+};
+
+
+/*
+ * Reads the result file of a finished sweep chunk by chunk
+ */
+struct reader{
+    const struct problem_info *p;   /* solved problem */
+    FILE *in;                       /* result file */
+    int binary;                     /* whether it holds binary columns */
+    int next_row;                   /* first grid row not read yet */
+};
+
+
+
+/*
+ * Writes the cartesian product of the sides as rows
+ * [km kw dm dw am bm aw bw], ordered by km, kw, dm, then dw, in the text
+ * or the binary columnar format. Returns 0 on success
+ */
+int write_pairs(const char *file_name, const struct problem_info *p,
+    const struct pair_side *m, const struct pair_side *w, int binary);
+
+/*
+ * Opens the result file in the text or the binary columnar format. With
+ * the journal, an existing journal of the same sweep is resumed and
+ * next_row is set past its last checkpoint. Returns 0 on success
+ */
+int writer_open(struct writer *w, const char *file_name,
+    const struct problem_info *p, int binary, int journal);
+
+/*
+ * Writes the result of the given count of rows starting from next_row
+ * and checkpoints it. Returns 0 on success
+ */
+int writer_put(struct writer *w, const struct result *res, int rows);
+
+/*
+ * Closes the result file and the journal. Returns 0 on success
+ */
+int writer_close(struct writer *w);
+
+/*
+ * Makes the name of the journal of the result file. Returns NULL if the
+ * memory is exhausted
+ */
+char *get_journal_name(const char *file_name);
+
+/*
+ * Makes the name of the shard file of the result file. Returns NULL if the
+ * memory is exhausted
+ */
+char *get_shard_name(const char *file_name, int index);
+
+/*
+ * Makes the problem of the shard of the sweep: the grid rows index,
+ * index + count, ... The excess of the rows is computed from their sweep
+ * rows and the accuracy tier is the one of the whole sweep given by
+ * get_accuracy, so the shard solves its points as the sweep does. Sweeps
+ * with continuation cannot be sharded, since points of a shard have other
+ * neighbours. Returns 1 if the shard has no rows
+ */
+int get_shard_problem(const struct problem_info *p, int index, int count,
+    int accuracy, struct problem_info *shard);
+
+/*
+ * Opens the result file written with the journal. Its journal must belong
+ * to the same sweep and checkpoint every row, and the file must end at the
+ * last checkpoint. Returns 0 on success
+ */
+int reader_open(struct reader *r, const char *file_name,
+    const struct problem_info *p, int binary);
+
+/*
+ * Reads the solution of the given count of rows starting from next_row
+ * into the result storage. Returns 0 on success
+ */
+int reader_get(struct reader *r, struct result *res, int rows);
+
+/*
+ * Closes the result file
+ */
+void reader_close(struct reader *r);
+
+/*
+ * Merges the count shards of the sweep into the result file, in the
+ * layout of the sweep solved at once. Returns 0 on success, the index + 1
+ * of the first shard that is missing, incomplete or unreadable, or -1 on
+ * the output error
+ */
+int merge_shards(const struct problem_info *p, int count, int binary,
+    const char *file_name);
+
+#endif
@@ -0,0 +1,893 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <gsl/gsl_integration.h>
+
+#include "vector.h"
+#include "quadrature.h"
+
+/*
+ * Gauss-Hermite orders: the first one and the count of doublings. Weights
+ * multiplied by exp(t^2) overflow beyond the order 256
+ */
+#define HERMITE_FIRST 16
+#define HERMITE_LEVELS 5
+
+/*
+ * Kernels fall to the tail threshold e^-27.63 at the integration bound,
+ * as the gaussian does at 7.43 standard deviations
+ */
+#define HERMITE_SPAN 7.433843581
+
+/*
+ * Count of weighted values summed plainly before the compensated addition
+ */
+#define QUAD_GROUP 16
+
+/*
+ * Maximal count of Gauss-Kronrod intervals
+ */
+#define KRONROD_MAX 128
+
+/*
+ * Alignment of the Simpson weight pattern, a cache line
+ */
+#define PATTERN_ALIGN 64
+
+/*
+ * Tanh-sinh rule: the half-width of the step space, where the weights
+ * fall below 1e-22, and the maximal count of step halvings
+ */
+#define TANH_SINH_SPAN 3.5
+#define TANH_SINH_LEVELS 12
+
+/*
+ * Romberg rule: the interval count of the first trapezoid sum, the count
+ * of halvings before the error estimate is trusted, so a coarse grid that
+ * misses the kernel core does not converge, and the maximal count of
+ * halvings
+ */
+#define ROMBERG_FIRST 32
+#define ROMBERG_MIN_LEVEL 2
+#define ROMBERG_LEVELS 20
+
+/*
+ * Gauss-Kronrod 7-15 nodes and weights. Odd nodes are the Gauss nodes
+ */
+static const double xgk[8] = {
+    0.991455371120812639206854697526329,
+    0.949107912342758524526189684047851,
+    0.864864423359769072789712788640926,
+    0.741531185599394439863864773280788,
+    0.586087235467691130294144845693013,
+    0.405845151377397166906606412076961,
+    0.207784955007898467600689403773245,
+    0.000000000000000000000000000000000
+};
+
+static const double wgk[8] = {
+    0.022935322010529224963732008058970,
+    0.063092092629978553290700663189204,
+    0.104790010322250183839876322541518,
+    0.140653259715525918745189590510238,
+    0.169004726639267902826583426598550,
+    0.190350578064785409913256402421014,
+    0.204432940075298892414161999234649,
+    0.209482141084727828012999174891714
+};
+
+static const double wg[4] = {
+    0.129484966168869693270611432679082,
+    0.279705391489276667901467771423780,
+    0.381830050505118944950369775488975,
+    0.417959183673469387755102040816327
+};
+
+
+
+/*
+ * Checks whether the error estimate is below the tolerance. The error is
+ * measured relative to the integral of |f|, not to the integral itself,
+ * so integrals that cancel to zero converge too
+ */
+static int is_accurate(double err, double mag, double tol)
+{
+    return err <= tol * mag;
+}
+
+
+
+/*
+ * Checks whether every integral changed less than the tolerance
+ */
+static int is_converged(const double *res, const double *prev,
+    const double *mag, int dim, double tol)
+{
+    int m;
+
+    for(m = 0; m < dim; m++){
+        if(!is_accurate(fabs(res[m] - prev[m]), fmax(fabs(res[m]), mag[m]),
+            tol))
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+
+
+/*
+ * Adds weighted integrand values at the points to the sums, and their
+ * absolute values to mag unless it is NULL. Weights must be positive.
+ * Groups of QUAD_GROUP values are summed into four partial sums, so
+ * additions do not wait for each other, and group sums are accumulated
+ * with compensation, so the rounding error does not grow with the block
+ * length
+ */
+static void add_values(Integrand f, void *ctx, int dim, const double *x,
+    const double *w, int n, double *res, double *mag)
+{
+    double vals[QUAD_MAX_DIM * QUAD_BLOCK];
+    const double *v;
+    double s0;
+    double s1;
+    double s2;
+    double s3;
+    double sum;
+    double comp;
+    int beg;
+    int end;
+    int m;
+    int i;
+
+    f(x, n, vals, ctx);
+    for(m = 0; m < dim; m++){
+        v = vals + m * n;
+        sum = comp = 0.0;
+        for(beg = 0; beg < n; beg += QUAD_GROUP){
+            end = n - beg < QUAD_GROUP ? n : beg + QUAD_GROUP;
+            s0 = s1 = s2 = s3 = 0.0;
+            for(i = beg; i + 3 < end; i += 4){
+                s0 += v[i] * w[i];
+                s1 += v[i + 1] * w[i + 1];
+                s2 += v[i + 2] * w[i + 2];
+                s3 += v[i + 3] * w[i + 3];
+            }
+            for(; i < end; i++){
+                s0 += v[i] * w[i];
+            }
+            add_compensated(&sum, &comp, (s0 + s1) + (s2 + s3));
+        }
+
+        res[m] += sum - comp;
+
+        if(mag != NULL){
+            s0 = 0.0;
+            for(i = 0; i < n; i++){
+                s0 += fabs(v[i]) * w[i];
+            }
+            mag[m] += s0;
+        }
+    }
+}
+
+
+
+/*=======================================================================*/
+/*                            Simpson's rule                             */
+/*=======================================================================*/
+/*
+ * Composite Simpson's rule on the fixed grid. Even functions are summed
+ * over the right half of the grid, that starts at zero with the end
+ * weight, so the doubled sum has the weight of an inner node at zero. The
+ * half grid node count is kept odd as Simpson's rule requires. Nodes are
+ * computed from their indices, so they do not drift, and weights are
+ * scaled from the pattern, with the end nodes fixed after the loop. Block
+ * sums are accumulated with Kahan compensation, so the rounding error
+ * does not grow with the count of blocks. The rule has no error estimate
+ */
+static int simpson(const struct quadrature *q, Integrand f, void *ctx,
+    int dim, double width, int symmetric, double *res, double *err)
+{
+    double xs[QUAD_BLOCK];
+    double ws[QUAD_BLOCK];
+    double part[QUAD_MAX_DIM];
+    double comp[QUAD_MAX_DIM];
+    double lo = symmetric ? 0.0 : -width;
+    double step;
+    double s;
+    int n = q->count;
+    int beg;
+    int len;
+    int i;
+
+    if(symmetric){
+        n = n / 2 + 1;
+        if(n % 2 == 0){
+            n++;
+        }
+    }
+
+    step = (width - lo) / (n - 1);
+    s = step / 3;
+
+    for(i = 0; i < dim; i++){
+        comp[i] = 0.0;
+    }
+
+    for(beg = 0; beg < n; beg += QUAD_BLOCK){
+        len = n - beg < QUAD_BLOCK ? n - beg : QUAD_BLOCK;
+        for(i = 0; i < len; i++){
+            xs[i] = lo + (beg + i) * step;
+            ws[i] = q->pattern[i] * s;
+        }
+
+        if(beg == 0){
+            ws[0] = s;
+        }
+        if(beg + len == n){
+            ws[len - 1] = s;
+        }
+
+        for(i = 0; i < dim; i++){
+            part[i] = 0.0;
+        }
+        add_values(f, ctx, dim, xs, ws, len, part, NULL);
+
+        for(i = 0; i < dim; i++){
+            add_compensated(res + i, comp + i, part[i]);
+        }
+    }
+
+    for(i = 0; i < dim; i++){
+        err[i] = NAN;
+        if(symmetric){
+            res[i] *= 2;
+        }
+    }
+
+    return n;
+}
+
+
+
+/*=======================================================================*/
+/*                     Adaptive Gauss-Kronrod rule                       */
+/*=======================================================================*/
+/*
+ * Gauss-Kronrod interval with its integrals, their Gauss estimates and
+ * the integrals of |f|
+ */
+struct interval{
+    double lo;
+    double hi;
+    double k[QUAD_MAX_DIM];
+    double g[QUAD_MAX_DIM];
+    double a[QUAD_MAX_DIM];
+};
+
+
+
+/*
+ * Applies the 7-15 rule to the interval
+ */
+static void kronrod_sum(Integrand f, void *ctx, int dim, struct interval *v)
+{
+    double xs[15];
+    double vals[QUAD_MAX_DIM * 15];
+    const double *fv;
+    double c = 0.5 * (v->lo + v->hi);
+    double h = 0.5 * (v->hi - v->lo);
+    double fc;
+    int m;
+    int i;
+
+    for(i = 0; i < 7; i++){
+        xs[2 * i] = c - h * xgk[i];
+        xs[2 * i + 1] = c + h * xgk[i];
+    }
+    xs[14] = c;
+
+    f(xs, 15, vals, ctx);
+    for(m = 0; m < dim; m++){
+        fv = vals + m * 15;
+        fc = fv[14];
+
+        v->k[m] = wgk[7] * fc;
+        v->g[m] = wg[3] * fc;
+        v->a[m] = wgk[7] * fabs(fc);
+        for(i = 0; i < 7; i++){
+            v->k[m] += wgk[i] * (fv[2 * i] + fv[2 * i + 1]);
+            v->a[m] += wgk[i] * (fabs(fv[2 * i]) + fabs(fv[2 * i + 1]));
+            if(i % 2 == 1){
+                v->g[m] += wg[i / 2] * (fv[2 * i] + fv[2 * i + 1]);
+            }
+        }
+
+        v->k[m] *= h;
+        v->g[m] *= h;
+        v->a[m] *= h;
+    }
+}
+
+
+
+/*
+ * Adaptive Gauss-Kronrod rule: the interval with the largest relative
+ * difference between Kronrod and Gauss estimates is bisected, until the
+ * total differences are below the tolerance. Differences are relative to
+ * the integrals of |f|, that are the scales of integrals cancelling to
+ * zero. The total differences are the error estimates. The count of
+ * points is negated if the tolerance is not reached with KRONROD_MAX
+ * intervals
+ */
+static int kronrod(const struct quadrature *q, Integrand f, void *ctx,
+    int dim, double width, int symmetric, double *res, double *err)
+{
+    struct interval v[KRONROD_MAX];
+    double mag[QUAD_MAX_DIM];
+    double e;
+    double worst;
+    double mid;
+    int count = 1;
+    int split;
+    int done;
+    int m;
+    int i;
+
+    v[0].lo = symmetric ? 0.0 : -width;
+    v[0].hi = width;
+    kronrod_sum(f, ctx, dim, &v[0]);
+
+    for(;;){
+        for(m = 0; m < dim; m++){
+            res[m] = err[m] = mag[m] = 0.0;
+            for(i = 0; i < count; i++){
+                res[m] += v[i].k[m];
+                err[m] += fabs(v[i].k[m] - v[i].g[m]);
+                mag[m] += v[i].a[m];
+            }
+            mag[m] = fmax(mag[m], fabs(res[m]));
+        }
+
+        done = 1;
+        for(m = 0; m < dim; m++){
+            if(!is_accurate(err[m], mag[m], q->tol)){
+                done = 0;
+            }
+        }
+
+        if(done || count == KRONROD_MAX){
+            break;
+        }
+
+        split = 0;
+        worst = -1.0;
+        for(i = 0; i < count; i++){
+            e = 0.0;
+            for(m = 0; m < dim; m++){
+                if(mag[m] > 0){
+                    e = fmax(e, fabs(v[i].k[m] - v[i].g[m]) / mag[m]);
+                }
+            }
+            if(e > worst){
+                worst = e;
+                split = i;
+            }
+        }
+
+        mid = 0.5 * (v[split].lo + v[split].hi);
+        v[count].lo = mid;
+        v[count].hi = v[split].hi;
+        v[split].hi = mid;
+        kronrod_sum(f, ctx, dim, &v[split]);
+        kronrod_sum(f, ctx, dim, &v[count]);
+        count++;
+    }
+
+    if(symmetric){
+        for(m = 0; m < dim; m++){
+            res[m] *= 2;
+            err[m] *= 2;
+        }
+    }
+
+    return done ? 15 * (2 * count - 1) : -15 * (2 * count - 1);
+}
+
+
+
+/*=======================================================================*/
+/*                         Gauss-Hermite rule                            */
+/*=======================================================================*/
+/*
+ * Fills the Gauss-Hermite orders. Only positive nodes are stored, the
+ * order is even, so there is no node at zero
+ */
+static int init_hermite(struct quadrature *q)
+{
+    gsl_integration_fixed_workspace *ws;
+    const double *t;
+    const double *w;
+    int size = HERMITE_FIRST;
+    int l;
+    int i;
+    int j;
+
+    q->levels = HERMITE_LEVELS;
+    q->sizes = calloc(q->levels, sizeof(int));
+    q->nodes = calloc(q->levels, sizeof(double *));
+    q->weights = calloc(q->levels, sizeof(double *));
+    if(q->sizes == NULL || q->nodes == NULL || q->weights == NULL){
+        return 1;
+    }
+
+    for(l = 0; l < q->levels; l++, size *= 2){
+        ws = gsl_integration_fixed_alloc(gsl_integration_fixed_hermite,
+            size, 0.0, 1.0, 0.0, 0.0);
+        if(ws == NULL){
+            return 1;
+        }
+
+        q->sizes[l] = size / 2;
+        q->nodes[l] = malloc(size / 2 * sizeof(double));
+        q->weights[l] = malloc(size / 2 * sizeof(double));
+        if(q->nodes[l] == NULL || q->weights[l] == NULL){
+            gsl_integration_fixed_free(ws);
+            return 1;
+        }
+
+        t = gsl_integration_fixed_nodes(ws);
+        w = gsl_integration_fixed_weights(ws);
+        for(i = 0, j = 0; i < size; i++){
+            if(t[i] > 0){
+                q->nodes[l][j] = t[i];
+                q->weights[l][j] = w[i] * exp(t[i] * t[i]);
+                j++;
+            }
+        }
+
+        gsl_integration_fixed_free(ws);
+    }
+
+    return 0;
+}
+
+
+
+/*
+ * Sums one Gauss-Hermite order for the gaussian of the given scale
+ */
+static int hermite_sum(const struct quadrature *q, int l, Integrand f,
+    void *ctx, int dim, double scale, int symmetric, double *res,
+    double *mag)
+{
+    double xs[QUAD_BLOCK];
+    double ws[QUAD_BLOCK];
+    int n = q->sizes[l];
+    int beg;
+    int len;
+    int i;
+
+    for(i = 0; i < dim; i++){
+        res[i] = mag[i] = 0.0;
+    }
+
+    for(beg = 0; beg < n; beg += QUAD_BLOCK / 2){
+        len = n - beg < QUAD_BLOCK / 2 ? n - beg : QUAD_BLOCK / 2;
+        for(i = 0; i < len; i++){
+            xs[i] = scale * q->nodes[l][beg + i];
+            ws[i] = scale * q->weights[l][beg + i];
+        }
+
+        if(symmetric){
+            for(i = 0; i < len; i++){
+                ws[i] *= 2;
+            }
+        }else{
+            for(i = 0; i < len; i++){
+                xs[len + i] = -xs[i];
+                ws[len + i] = ws[i];
+            }
+            len *= 2;
+        }
+
+        add_values(f, ctx, dim, xs, ws, len, res, mag);
+    }
+
+    return symmetric ? n : 2 * n;
+}
+
+
+
+/*
+ * Gauss-Hermite rule with the weight of the gaussian, that has the same
+ * tail bound as the integrand. The order is doubled until integrals
+ * converge, their last changes are the error estimates. Integrands with
+ * a core much narrower than the tail do not converge, they are integrated
+ * by the Gauss-Kronrod rule
+ */
+static int hermite(const struct quadrature *q, Integrand f, void *ctx,
+    int dim, double width, int symmetric, double *res, double *err)
+{
+    double prev[QUAD_MAX_DIM];
+    double mag[QUAD_MAX_DIM];
+    double scale = M_SQRT2 * width / HERMITE_SPAN;
+    int count = 0;
+    int rest;
+    int l;
+    int m;
+
+    for(l = 0; l < q->levels; l++){
+        memcpy(prev, res, dim * sizeof(double));
+        count += hermite_sum(q, l, f, ctx, dim, scale, symmetric, res, mag);
+
+        if(l > 0 && is_converged(res, prev, mag, dim, q->tol)){
+            for(m = 0; m < dim; m++){
+                err[m] = fabs(res[m] - prev[m]);
+            }
+            return count;
+        }
+    }
+
+    rest = kronrod(q, f, ctx, dim, width, symmetric, res, err);
+
+    return rest < 0 ? rest - count : rest + count;
+}
+
+
+
+/*=======================================================================*/
+/*                           Tanh-sinh rule                              */
+/*=======================================================================*/
+/*
+ * Adds the tanh-sinh nodes t = j h, j = first, first + stride, ... to the
+ * sums. Nodes are x(t) = lo + (hi - lo) / (1 + exp(-2u)), u = pi/2 sinh(t),
+ * that keeps nodes near both ends without cancellation
+ */
+static int tanh_sinh_sum(Integrand f, void *ctx, int dim, double lo,
+    double hi, double h, int first, int stride, double *res, double *mag)
+{
+    double xs[QUAD_BLOCK];
+    double ws[QUAD_BLOCK];
+    double t;
+    double u;
+    double e;
+    int last = -first;
+    int len = 0;
+    int j;
+
+    for(j = first; j <= last; j += stride){
+        t = j * h;
+        u = M_PI_2 * sinh(t);
+        e = exp(-2 * u);
+        xs[len] = lo + (hi - lo) / (1 + e);
+        ws[len] = h * (hi - lo) * M_PI * cosh(t) * e / ((1 + e) * (1 + e));
+
+        if(++len == QUAD_BLOCK || j + stride > last){
+            add_values(f, ctx, dim, xs, ws, len, res, mag);
+            len = 0;
+        }
+    }
+
+    return (last - first) / stride + 1;
+}
+
+
+
+/*
+ * Tanh-sinh rule. The step is halved until integrals converge, each level
+ * halves the previous sums and adds only the new odd nodes. The last
+ * changes of integrals are the error estimates. The count of points is
+ * negated if integrals do not converge in TANH_SINH_LEVELS
+ */
+static int tanh_sinh(const struct quadrature *q, Integrand f, void *ctx,
+    int dim, double width, int symmetric, double *res, double *err)
+{
+    double prev[QUAD_MAX_DIM];
+    double mag[QUAD_MAX_DIM];
+    double lo = symmetric ? 0.0 : -width;
+    double h = 1.0;
+    int first = -(int)(TANH_SINH_SPAN / h);
+    int count;
+    int done = 0;
+    int l;
+    int m;
+
+    memset(mag, 0, sizeof(mag));
+    count = tanh_sinh_sum(f, ctx, dim, lo, width, h, first, 1, res, mag);
+
+    for(l = 1; l <= TANH_SINH_LEVELS && !done; l++){
+        memcpy(prev, res, dim * sizeof(double));
+        for(m = 0; m < dim; m++){
+            res[m] *= 0.5;
+            mag[m] *= 0.5;
+        }
+
+        h *= 0.5;
+        first = -(int)(TANH_SINH_SPAN / h);
+        if(first % 2 == 0){
+            first++;
+        }
+        count += tanh_sinh_sum(f, ctx, dim, lo, width, h, first, 2, res,
+            mag);
+
+        done = is_converged(res, prev, mag, dim, q->tol);
+    }
+
+    for(m = 0; m < dim; m++){
+        err[m] = fabs(res[m] - prev[m]);
+        if(symmetric){
+            res[m] *= 2;
+            err[m] *= 2;
+        }
+    }
+
+    return done ? count : -count;
+}
+
+
+
+/*=======================================================================*/
+/*                             Romberg rule                              */
+/*=======================================================================*/
+/*
+ * Adds the nodes lo + j h, j = first, first + stride, ..., last, of the
+ * weight h to the sums
+ */
+static int romberg_sum(Integrand f, void *ctx, int dim, double lo, double h,
+    int first, int stride, int last, double *res, double *mag)
+{
+    double xs[QUAD_BLOCK];
+    double ws[QUAD_BLOCK];
+    int len = 0;
+    int j;
+
+    for(j = first; j <= last; j += stride){
+        xs[len] = lo + j * h;
+        ws[len] = h;
+
+        if(++len == QUAD_BLOCK || j + stride > last){
+            add_values(f, ctx, dim, xs, ws, len, res, mag);
+            len = 0;
+        }
+    }
+
+    return (last - first) / stride + 1;
+}
+
+
+
+/*
+ * Romberg rule. The trapezoid step is halved, each level halves the
+ * previous sums and adds only the new odd nodes, so all samples are
+ * reused. Level l of the table removes the h^2l error term by Richardson
+ * extrapolation:
+ *
+ *     R(l, j) = R(l, j - 1) + (R(l, j - 1) - R(l - 1, j - 1)) / (4^j - 1)
+ *
+ * where R(l, 1) is Simpson's rule on the grid of the level. The change
+ * of the diagonal R(l, l) estimates the error of every integral, the
+ * step is halved until the estimates are below the tolerance relative to
+ * the trapezoid sums of |f|, or the grid would exceed the node count of
+ * the rule. The first grid is made coarser for small node counts, so that
+ * ROMBERG_MIN_LEVEL levels fit. Integrands with a cusp, as the Roughgarden
+ * kernel of the power below 2, do not converge within the node count, they
+ * are integrated by the Gauss-Kronrod rule
+ */
+static int romberg(const struct quadrature *q, Integrand f, void *ctx,
+    int dim, double width, int symmetric, double *res, double *err)
+{
+    double table[2][ROMBERG_LEVELS + 1][QUAD_MAX_DIM];
+    double sums[QUAD_MAX_DIM];
+    double ends[QUAD_MAX_DIM];
+    double mag[QUAD_MAX_DIM];
+    double mag_ends[QUAD_MAX_DIM];
+    double (*row)[QUAD_MAX_DIM] = table[0];
+    double (*prev)[QUAD_MAX_DIM] = table[1];
+    double lo = symmetric ? 0.0 : -width;
+    double h;
+    double scale;
+    int n = ROMBERG_FIRST;
+    int level = 0;
+    int count;
+    int rest;
+    int done = 0;
+    int l;
+    int j;
+    int m;
+
+    while(n > 1 && (n << ROMBERG_MIN_LEVEL) + 1 > q->count){
+        n /= 2;
+    }
+    h = (width - lo) / n;
+
+    /* the end nodes have the half weight */
+    memset(sums, 0, sizeof(sums));
+    memset(ends, 0, sizeof(ends));
+    memset(mag, 0, sizeof(mag));
+    memset(mag_ends, 0, sizeof(mag_ends));
+    count = romberg_sum(f, ctx, dim, lo, h, 1, 1, n - 1, sums, mag);
+    count += romberg_sum(f, ctx, dim, lo, h, 0, n, n, ends, mag_ends);
+    for(m = 0; m < dim; m++){
+        row[0][m] = sums[m] + 0.5 * ends[m];
+        mag[m] += 0.5 * mag_ends[m];
+    }
+
+    for(l = 1; l <= ROMBERG_LEVELS && 2 * n + 1 <= q->count; l++){
+        prev = row;
+        row = table[l % 2];
+
+        h *= 0.5;
+        n *= 2;
+        memset(sums, 0, sizeof(sums));
+        for(m = 0; m < dim; m++){
+            mag[m] *= 0.5;
+        }
+        count += romberg_sum(f, ctx, dim, lo, h, 1, 2, n - 1, sums, mag);
+
+        for(m = 0; m < dim; m++){
+            row[0][m] = 0.5 * prev[0][m] + sums[m];
+        }
+
+        scale = 1.0;
+        for(j = 1; j <= l; j++){
+            scale *= 4;
+            for(m = 0; m < dim; m++){
+                row[j][m] = row[j - 1][m] +
+                    (row[j - 1][m] - prev[j - 1][m]) / (scale - 1);
+            }
+        }
+        level = l;
+
+        done = l >= ROMBERG_MIN_LEVEL;
+        for(m = 0; m < dim; m++){
+            if(!is_accurate(fabs(row[l][m] - prev[l - 1][m]),
+                fmax(fabs(row[l][m]), mag[m]), q->tol))
+            {
+                done = 0;
+            }
+        }
+
+        if(done){
+            break;
+        }
+    }
+
+    if(!done){
+        rest = kronrod(q, f, ctx, dim, width, symmetric, res, err);
+        return rest < 0 ? rest - count : rest + count;
+    }
+
+    for(m = 0; m < dim; m++){
+        res[m] = symmetric ? 2 * row[level][m] : row[level][m];
+        err[m] = fabs(row[level][m] - prev[level - 1][m]);
+        if(symmetric){
+            err[m] *= 2;
+        }
+    }
+
+    return count;
+}
+
+
+
+/*=======================================================================*/
+/*                              Interface                                */
+/*=======================================================================*/
+struct quadrature *quad_alloc(char type, int count, double tol)
+{
+    struct quadrature *q;
+    int i;
+
+    if(type != QUAD_SIMPSON && type != QUAD_HERMITE &&
+        type != QUAD_KRONROD && type != QUAD_TANH_SINH &&
+        type != QUAD_ROMBERG && type != QUAD_EXACT)
+    {
+        return NULL;
+    }
+
+    q = calloc(1, sizeof(struct quadrature));
+    if(q == NULL){
+        return NULL;
+    }
+
+    q->type = type;
+    q->count = count;
+    q->tol = fmax(tol, QUAD_MIN_TOL);
+
+    /* blocks start at even nodes, so the pattern is the same for all */
+    if(type == QUAD_SIMPSON){
+        q->pattern = aligned_alloc(PATTERN_ALIGN,
+            QUAD_BLOCK * sizeof(double));
+        if(q->pattern == NULL){
+            quad_free(q);
+            return NULL;
+        }
+
+        for(i = 0; i < QUAD_BLOCK; i++){
+            q->pattern[i] = i % 2 == 1 ? 4.0 : 2.0;
+        }
+    }
+
+    if(type == QUAD_HERMITE && init_hermite(q) != 0){
+        quad_free(q);
+        return NULL;
+    }
+
+    return q;
+}
+
+
+
+void quad_free(struct quadrature *q)
+{
+    int l;
+
+    if(q == NULL){
+        return;
+    }
+
+    for(l = 0; l < q->levels; l++){
+        if(q->nodes != NULL){
+            free(q->nodes[l]);
+        }
+        if(q->weights != NULL){
+            free(q->weights[l]);
+        }
+    }
+
+    free(q->pattern);
+    free(q->sizes);
+    free(q->nodes);
+    free(q->weights);
+    free(q);
+}
+
+
+
+int quad_integrate(
+    const struct quadrature *q,
+    Integrand f,
+    void *ctx,
+    int dim,
+    double width,
+    int symmetric,
+    double *res,
+    double *err
+)
+{
+    double e[QUAD_MAX_DIM];
+    int count;
+    int m;
+
+    for(m = 0; m < dim; m++){
+        res[m] = 0.0;
+    }
+
+    switch(q->type){
+        case QUAD_HERMITE:
+            count = hermite(q, f, ctx, dim, width, symmetric, res, e);
+            break;
+        case QUAD_KRONROD:
+        case QUAD_EXACT:
+            count = kronrod(q, f, ctx, dim, width, symmetric, res, e);
+            break;
+        case QUAD_TANH_SINH:
+            count = tanh_sinh(q, f, ctx, dim, width, symmetric, res, e);
+            break;
+        case QUAD_ROMBERG:
+            count = romberg(q, f, ctx, dim, width, symmetric, res, e);
+            break;
+        default:
+            count = simpson(q, f, ctx, dim, width, symmetric, res, e);
+    }
+
+    if(err != NULL){
+        memcpy(err, e, dim * sizeof(double));
+    }
+
+    return count;
+}
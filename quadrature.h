@@ -0,0 +1,90 @@
+#ifndef QUADRATURE_MODULE_H
+#define QUADRATURE_MODULE_H
+
+#include <float.h>
+
+/*
+ * Avaliable quadrature rules
+ */
+#define QUAD_SIMPSON 's'            /* composite Simpson, fixed nodes */
+#define QUAD_HERMITE 'h'            /* Gauss-Hermite, doubling orders */
+#define QUAD_KRONROD 'k'            /* adaptive Gauss-Kronrod 7-15 */
+#define QUAD_TANH_SINH 't'          /* double exponential, halving steps */
+#define QUAD_ROMBERG 'r'            /* extrapolated nested trapezoids */
+#define QUAD_EXACT 'e'              /* closed form, Gauss-Kronrod if none */
+
+/*
+ * Maximal count of functions integrated together and maximal count of
+ * points passed to the integrand at once
+ */
+#define QUAD_MAX_DIM 12
+#define QUAD_BLOCK 256
+
+/*
+ * Relative tolerance of the moments for adaptive quadrature rules, per
+ * the solver precision
+ */
+#define QUAD_TOL 1e-3
+
+/*
+ * Least relative tolerance: rounding of the sums does not let adaptive
+ * rules reach tighter ones
+ */
+#define QUAD_MIN_TOL (64 * DBL_EPSILON)
+
+/*
+ * Vector integrand: writes values of dim functions at n points, the value
+ * of the function m at the point i goes to f[m * n + i]
+ */
+typedef void (*Integrand)(const double *x, int n, double *f, void *ctx);
+
+
+
+/*
+ * Quadrature rule representation
+ */
+struct quadrature{
+    char type;                      /* rule type */
+    int count;                      /* Simpson or Romberg max node count */
+    double tol;                     /* relative tolerance of other rules */
+    double *pattern;                /* Simpson inner weights of a block */
+
+    int levels;                     /* count of Gauss-Hermite orders */
+    int *sizes;                     /* positive node counts of the orders */
+    double **nodes;                 /* positive Gauss-Hermite nodes */
+    double **weights;               /* weights multiplied by exp(t^2) */
+};
+
+
+
+/*
+ * Creates a quadrature rule. Tolerances below QUAD_MIN_TOL are raised to
+ * it. Returns NULL for unknown types
+ */
+struct quadrature *quad_alloc(char type, int count, double tol);
+
+/*
+ * Frees the quadrature rule
+ */
+void quad_free(struct quadrature *q);
+
+/*
+ * Integrates dim functions over [-width, width]. Even functions are
+ * integrated over [0, width] and doubled. Writes integrals to res and
+ * estimates of their absolute errors to err unless it is NULL; Simpson's
+ * rule has no estimates and writes NAN. Returns the count of points where
+ * the integrand was evaluated. The count is negated if an adaptive rule
+ * has not reached its tolerance, res holds the last estimates then
+ */
+int quad_integrate(
+    const struct quadrature *q,
+    Integrand f,
+    void *ctx,
+    int dim,
+    double width,
+    int symmetric,
+    double *res,
+    double *err
+);
+
+#endif
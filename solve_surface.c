@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "surface.h"
+
+/*
+ * Holds command line options
+ */
+struct surface_options{
+    const char *command;            /* pair solver command or NULL */
+    struct surface_model model;
+    int thread_count;
+};
+
+
+
+/*
+ * Parses command line options. Returns the index of the first positional
+ * argument or -1 if options are invalid
+ */
+int parse_options(int argc, char **argv, struct surface_options *o)
+{
+    int c;
+
+    o->command = NULL;
+    o->model.b = 1.0;
+    o->model.d = 0.0;
+    o->model.s = 0.4;
+    o->model.dim = 1;
+    o->thread_count = 4;
+
+    while((c = getopt(argc, argv, "b:d:D:s:t:x:")) != -1){
+        switch(c){
+        case 'b':
+            if(sscanf(optarg, "%lf", &(o->model.b)) != 1){
+                return -1;
+            }
+            break;
+        case 'd':
+            if(sscanf(optarg, "%lf", &(o->model.d)) != 1){
+                return -1;
+            }
+            break;
+        case 'D':
+            if(sscanf(optarg, "%d", &(o->model.dim)) != 1 ||
+                o->model.dim < 1)
+            {
+                return -1;
+            }
+            break;
+        case 's':
+            if(sscanf(optarg, "%lf", &(o->model.s)) != 1 ||
+                !(o->model.s > 0))
+            {
+                return -1;
+            }
+            break;
+        case 't':
+            if(sscanf(optarg, "%d", &(o->thread_count)) != 1 ||
+                o->thread_count < 1)
+            {
+                return -1;
+            }
+            break;
+        case 'x':
+            o->command = optarg;
+            break;
+        default:
+            return -1;
+        }
+    }
+
+    return optind;
+}
+
+
+
+/*
+ * Solves the pair table into the surface. Options: -x command of the pair
+ * solver (the stub solver if absent), -b, -d, -s model rates, -D space
+ * dimension, -t thread count. Arguments: pair table file (args.txt by
+ * default) and surface file (surface<D>d.plt by default)
+ */
+int main(int argc, char **argv)
+{
+    struct surface_options o;
+    struct surface_info info;
+    char out_name[64];
+    const char *in_name;
+    FILE *in;
+    FILE *out;
+    long failed;
+    int first;
+    int status;
+
+    first = parse_options(argc, argv, &o);
+    if(first < 0 || argc - first > 2){
+        fprintf(stderr, "### Invalid arguments!\n");
+        return 1;
+    }
+
+    in_name = first < argc ? argv[first] : "args.txt";
+    snprintf(out_name, sizeof(out_name), "surface%dd.plt", o.model.dim);
+
+    in = fopen(in_name, "r");
+    if(in == NULL){
+        fprintf(stderr, "### Cannot open pair table!\n");
+        return 1;
+    }
+
+    out = fopen(first + 1 < argc ? argv[first + 1] : out_name, "w");
+    if(out == NULL){
+        fclose(in);
+        fprintf(stderr, "### Cannot open output!\n");
+        return 1;
+    }
+
+    info.solver = o.command != NULL ? &command_pair_solver : &stub_pair_solver;
+    info.ctx = (void *)o.command;
+    info.model = o.model;
+    info.thread_count = o.thread_count;
+
+    status = solve_surface(in, out, &info, &failed);
+
+    fclose(in);
+    if(fclose(out) != 0){
+        status = 1;
+    }
+
+    if(status != 0){
+        fprintf(stderr, "### Cannot solve surface!\n");
+        return 1;
+    }
+
+    printf("Failed points: %ld\n", failed);
+
+    return 0;
+}
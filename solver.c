@@ -1,5 +1,88 @@
 #include "solver.h"
 
+/*
+ * Count of grid rows in one continuation band
+ */
+#define BAND_ROWS 4
+
+/*
+ * Count of grid points solved and written at once in the streaming mode
+ */
+#define CHUNK_POINTS 65536
+
+/*
+ * The pilot points of the cost model are taken every PILOT_STEP rows and
+ * columns
+ */
+#define PILOT_STEP 8
+
+/*
+ * Continued solutions may change a significant parameter at most by this
+ * factor without changing its sign. A parameter is significant if it is
+ * not below BRANCH_MIN of the largest one
+ */
+#define BRANCH_JUMP 8.0
+#define BRANCH_MIN 1e-2
+
+
+
+/*
+ * Holds tasks of a solving thread by descending cost. The owner takes
+ * them from the head, other threads steal them from the tail
+ */
+struct task_queue{
+    pthread_mutex_t lock;           /* guards the queue */
+    int *tasks;                     /* tasks */
+    int head;                       /* next task of the owner */
+    int tail;                       /* end of tasks */
+};
+
+
+
+/*
+ * Holds info about a grid sweep shared by the solving threads. A task is
+ * a grid point, or a band of BAND_ROWS rows in the continuation mode.
+ * Tasks are solved independently into their own result cells, so results
+ * do not depend on the thread count nor on the task order
+ */
+struct sweep{
+    struct problem_info *p;         /* problem to solve */
+    struct result *res;             /* result storage */
+    int accuracy;                   /* kernel evaluation accuracy tier */
+    int first;                      /* first row of the sweep */
+    int last;                       /* row after the last one */
+
+    pthread_mutex_t lock;           /* guards the next task */
+    int next;                       /* next unsolved task index */
+    int count;                      /* task count */
+    const int *order;               /* tasks in the order or NULL */
+    double *costs;                  /* measured task costs or NULL */
+
+    struct task_queue *queues;      /* queues of the threads or NULL */
+    int queue_count;                /* count of queues */
+    int next_queue;                 /* queue of the next started thread */
+};
+
+
+
+
+
+
+/*
+ * Holds the last solved points of a continuation chain
+ */
+struct chain{
+    int count;                      /* count of solved points, up to 2 */
+    double k[2];                    /* excess targets, [1] is the last */
+    double d[2];                    /* dispersion targets */
+    double a[2];                    /* solutions */
+    double b[2];
+    double J[4];                    /* jacobian at the last point */
+    int has_jacobian;               /* whether the jacobian is known */
+};
+
+
+
 /*
  * Initializes multidimensional fdf solver
  */
@@ -22,18 +105,54 @@ static gsl_multiroot_fsolver *make_f_solver()
 
 
 
-/*
- * Initializes result information
- */
-static void init_result_info(struct result *res, struct problem_info *p)
+void init_result_info(struct result *res, const struct problem_info *p,
+    int rows)
 {
-    int length = p->k_grid.count * p->d_grid.count;
+    int length = rows * p->d_grid.count;
 
     res->a.storage = malloc(sizeof(double) * length);
     res->a.grid.count = length;
 
     res->b.storage = malloc(sizeof(double) * length);
     res->b.grid.count = length;
+
+    res->calls = 0;
+}
+
+
+
+double get_row_k(const struct problem_info *p, int row)
+{
+    return p->k_grid.origin +
+        (p->row_first + row * p->row_stride) * p->k_grid.step;
+}
+
+
+
+int get_accuracy(const struct problem_info *p)
+{
+    const struct kernel *kern = get_kernel(p->kern_type);
+    double k_last = get_row_k(p, p->k_grid.count - 1);
+    double d_last = p->d_grid.origin + p->d_grid.step * (p->d_grid.count - 1);
+    double k = fmax(get_row_k(p, 0), k_last);
+    double d = fmax(fabs(p->d_grid.origin), fabs(d_last));
+    double e;
+    double bound;
+
+    if(p->accuracy == VM_FULL){
+        return VM_FULL;
+    }
+
+    e = get_kernel_error(kern, p->accuracy);
+    bound = 2 * e / (1 - e) * d * d + 4 * e / (1 - e) / (1 - e) * (k + 3);
+    if(bound > 0.5 * p->eps){
+        fprintf(stderr, "%s kernels are too rough for eps = %lg, "
+            "full precision is used\n",
+            p->accuracy == VM_SINGLE ? "Single precision" : "Fast", p->eps);
+        return VM_FULL;
+    }
+
+    return p->accuracy;
 }
 
 
@@ -89,24 +208,23 @@ static void get_begin(struct problem_info *p, double d, double k, double *a,
 
 
 /*
- * Solves an equation system using fdf solver
+ * Solves an equation system using fdf solver from the begin solution x.
+ * Returns GSL_SUCCESS if the residual has reached the precision. The
+ * iterations are added to the count
  */
-static void find_root_fdf(
+static int find_root_fdf(
     double *a,
     double *b,
     gsl_multiroot_fdfsolver *solver,
     gsl_multiroot_function_fdf *f,
     int max_iter_count,
+    int *iterations,
     double eps,
-    double beg_a,
-    double beg_b
+    gsl_vector *x
 )
 {
     int status;
     size_t iter = 0;
-    gsl_vector *x = gsl_vector_alloc(2);
-    gsl_vector_set(x, 0, beg_a);
-    gsl_vector_set(x, 1, beg_b);
 
     gsl_multiroot_fdfsolver_set(solver, f, x);
 
@@ -115,7 +233,6 @@ static void find_root_fdf(
         status = gsl_multiroot_fdfsolver_iterate(solver);
 
         if(status){
-            printf("Stucked! (%ld)\n", iter);
             break;
         }
 
@@ -124,98 +241,31 @@ static void find_root_fdf(
 
     *a = gsl_vector_get(solver->x, 0);
     *b = gsl_vector_get(solver->x, 1);
+    *iterations += iter;
 
-    gsl_vector_free(x);
-}
-
-
-
-/*
- * Solves the problem using derevative method
- */
-static struct result solve_fdf(struct problem_info *p)
-{
-    int i;
-    int j;
-    double k = p->k_grid.origin;
-    double d;
-    double a;
-    double b;
-    gsl_multiroot_fdfsolver *solver = make_fdf_solver();
-    gsl_multiroot_function_fdf f = { p->f, p->df, p->fdf, 2, NULL };
-    struct params params;
-    struct result res;
-
-    init_result_info(&res, p);
-    params.buffer.storage = malloc(sizeof(double) * p->space_grid.count);
-    params.buffer.grid = p->space_grid;
-    f.params = &params;
-
-    for(i = 0; i < p->k_grid.count; i++){
-        d = p->d_grid.origin;
-        for(j = 0; j < p->d_grid.count; j++){
-            params.k = k;
-            params.d = d * d;
-
-#           ifdef DEBUG
-            printf("Space: [%lf; %lf]\n", params.buffer.grid.origin,
-                params.buffer.grid.origin + params.buffer.grid.step *
-                params.buffer.grid.count);
-#           endif
-
-            get_begin(p, params.d, params.k, &a, &b); 
-            find_root_fdf(
-                res.a.storage + i * p->d_grid.count + j,
-                res.b.storage + i * p->d_grid.count + j,
-                solver,
-                &f,
-                p->iter_count,
-                p->eps,
-                a,
-                b
-            );
-            printf(
-                "Input: (k = %lf, d = %lf)\n"
-                "Solution: (a= %lf, b= %lf)\n\n",
-                k,
-                params.d,
-                res.a.storage[i * p->d_grid.count + j],
-                res.b.storage[i * p->d_grid.count + j]
-            );
-
-            d += p->d_grid.step;
-        }
-
-        k += p->k_grid.step;
-    }
-
-    free(params.buffer.storage);
-    gsl_multiroot_fdfsolver_free(solver);
-
-    return res;
+    return status;
 }
 
 
 
 /*
- * Solves an equation system using simple iterative solver
+ * Solves an equation system using simple iterative solver from the begin
+ * solution x. Returns GSL_SUCCESS if the residual has reached the
+ * precision. The iterations are added to the count
  */
-static void find_root_f(
+static int find_root_f(
     double *a,
     double *b,
     gsl_multiroot_fsolver *solver,
     gsl_multiroot_function *f,
     int max_iter_count,
+    int *iterations,
     double eps,
-    double beg_a,
-    double beg_b
+    gsl_vector *x
 )
 {
     int status;
     size_t iter = 0;
-    gsl_vector *x = gsl_vector_alloc(2);
-    gsl_vector_set(x, 0, beg_a);
-    gsl_vector_set(x, 1, beg_b);
 
     gsl_multiroot_fsolver_set(solver, f, x);
 
@@ -224,7 +274,6 @@ static void find_root_f(
         status = gsl_multiroot_fsolver_iterate(solver);
 
         if(status){
-            printf("Stucked! (%ld)\n", iter);
             break;
         }
 
@@ -233,84 +282,881 @@ static void find_root_f(
 
     *a = gsl_vector_get(solver->x, 0);
     *b = gsl_vector_get(solver->x, 1);
+    *iterations += iter;
 
-    gsl_vector_free(x);
+    return status;
+}
+
+
+
+void init_worker(struct worker *w, struct problem_info *p, int accuracy)
+{
+    w->p = p;
+    w->offset = 0;
+    w->x = gsl_vector_alloc(2);
+    w->params.grid = p->space_grid;
+    w->params.space_dim = p->space_dim;
+    w->params.accuracy = accuracy;
+    w->params.quad = p->quad;
+    w->params.prefetch = p->fdf != NULL;
+    clear_cache(&(w->params));
+    w->fdf_solver = NULL;
+    w->f_solver = NULL;
+    w->records = p->telemetry != NULL
+        ? malloc(sizeof(struct point_record) * TELEMETRY_BLOCK)
+        : NULL;
+    w->record_count = 0;
+
+    if(p->fdf != NULL){
+        w->fdf_solver = make_fdf_solver();
+        w->fdf.f = p->f;
+        w->fdf.df = p->df;
+        w->fdf.fdf = p->fdf;
+        w->fdf.n = 2;
+        w->fdf.params = &(w->params);
+    }else{
+        w->f_solver = make_f_solver();
+        w->f.f = p->f;
+        w->f.n = 2;
+        w->f.params = &(w->params);
+    }
+}
+
+
+
+void free_worker(struct worker *w)
+{
+    if(w->records != NULL){
+        telemetry_put(w->p->telemetry, w->records, w->record_count);
+        free(w->records);
+    }
+
+    if(w->fdf_solver != NULL){
+        gsl_multiroot_fdfsolver_free(w->fdf_solver);
+    }
+
+    if(w->f_solver != NULL){
+        gsl_multiroot_fsolver_free(w->f_solver);
+    }
+
+    gsl_vector_free(w->x);
+}
+
+
+
+/*
+ * Solves the current target of the worker from the given begin solution.
+ * The iterations and the residual are kept for the telemetry
+ */
+static int find_root(struct worker *w, int max_iter_count, double beg_a,
+    double beg_b, double *a, double *b)
+{
+    const gsl_vector *f;
+    int status;
+
+    gsl_vector_set(w->x, 0, beg_a);
+    gsl_vector_set(w->x, 1, beg_b);
+
+    if(w->fdf_solver != NULL){
+        status = find_root_fdf(a, b, w->fdf_solver, &(w->fdf),
+            max_iter_count, &(w->iterations), w->p->eps, w->x);
+        f = w->fdf_solver->f;
+    }else{
+        status = find_root_f(a, b, w->f_solver, &(w->f), max_iter_count,
+            &(w->iterations), w->p->eps, w->x);
+        f = w->f_solver->f;
+    }
+
+    w->residual = fabs(gsl_vector_get(f, 0)) + fabs(gsl_vector_get(f, 1));
+
+    return status;
+}
+
+
+
+/*
+ * Takes the next unsolved task. Returns -1 if all tasks are taken
+ */
+static int next_task(struct sweep *s)
+{
+    int index;
+
+    pthread_mutex_lock(&(s->lock));
+    index = s->next < s->count ? s->next++ : -1;
+    pthread_mutex_unlock(&(s->lock));
+
+    return index >= 0 && s->order != NULL ? s->order[index] : index;
 }
 
 
 
 /*
- * Solves the problem using simple iterative method
+ * Returns the count of tasks left in the queue
  */
-static struct result solve_f(struct problem_info *p)
+static int queue_size(struct task_queue *q)
 {
+    int size;
+
+    pthread_mutex_lock(&(q->lock));
+    size = q->tail - q->head;
+    pthread_mutex_unlock(&(q->lock));
+
+    return size;
+}
+
+
+
+/*
+ * Takes the next task of the queue from its head. If the queue is empty,
+ * steals the cheapest task of the fullest other queue. Returns -1 if all
+ * tasks are taken
+ */
+static int take_task(struct sweep *s, int queue)
+{
+    struct task_queue *q = s->queues + queue;
+    int task = -1;
+    int victim;
+    int most;
+    int size;
     int i;
-    int j;
-    double k = p->k_grid.origin;
-    double d;
-    double a;
-    double b;
-    gsl_multiroot_fsolver *solver = make_f_solver();
-    gsl_multiroot_function f = { p->f, 2, NULL };
-    struct params params;
-    struct result res;
 
-    init_result_info(&res, p);
-    params.buffer.storage = malloc(sizeof(double) * p->space_grid.count);
-    params.buffer.grid = p->space_grid;
-    f.params = &params;
+    pthread_mutex_lock(&(q->lock));
+    if(q->head < q->tail){
+        task = q->tasks[q->head++];
+    }
+    pthread_mutex_unlock(&(q->lock));
+
+    while(task < 0){
+        victim = -1;
+        most = 0;
+        for(i = 0; i < s->queue_count; i++){
+            size = queue_size(s->queues + i);
+            if(size > most){
+                most = size;
+                victim = i;
+            }
+        }
+
+        if(victim < 0){
+            break;
+        }
+
+        /* the victim may have been emptied since its size was read */
+        q = s->queues + victim;
+        pthread_mutex_lock(&(q->lock));
+        if(q->head < q->tail){
+            task = q->tasks[--(q->tail)];
+        }
+        pthread_mutex_unlock(&(q->lock));
+    }
+
+    return task;
+}
+
+
+
+/*
+ * Sets the target values of the grid point
+ */
+static void set_point(struct problem_info *p, int index, struct params *params)
+{
+    int i = index / p->d_grid.count;
+    int j = index % p->d_grid.count;
+    double d = p->d_grid.origin + j * p->d_grid.step;
+
+    params->k = get_row_k(p, i);
+    params->d = d * d;
+}
+
+
+
+/*
+ * Checks whether the solution continues the branch of the last solution
+ * of the chain. The kernel equations have spurious roots, where the kernel
+ * grows beyond a local minimum, and an extrapolated start may jump there
+ */
+static int on_branch(const struct chain *c, double a, double b)
+{
+    double v[2] = { a, b };
+    double last[2] = { c->a[1], c->b[1] };
+    double top = fmax(fabs(last[0]), fabs(last[1]));
+    int i;
+
+    for(i = 0; i < 2; i++){
+        if(fabs(last[i]) < BRANCH_MIN * top){
+            continue;
+        }
+
+        if(!(v[i] / last[i] >= 1 / BRANCH_JUMP &&
+            v[i] / last[i] <= BRANCH_JUMP))
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+
+
+/*
+ * Predicts the solution of the current target from the chain. The tangent
+ * J^-1 (dk, dd) is used if the jacobian is known, otherwise the secant
+ * through the last two points if the target lies on their line, otherwise
+ * the last solution itself. Returns 0 if there is nothing to predict from
+ * or the prediction leaves the branch
+ */
+static int predict(const struct chain *c, const struct params *params,
+    double *a, double *b)
+{
+    double dk;
+    double dd;
+    double det;
+    double vk;
+    double vd;
+    double t;
+
+    if(c->count == 0){
+        return 0;
+    }
+
+    dk = params->k - c->k[1];
+    dd = params->d - c->d[1];
+    *a = c->a[1];
+    *b = c->b[1];
+
+    if(c->has_jacobian){
+        det = c->J[0] * c->J[3] - c->J[1] * c->J[2];
+        if(det != 0 && isfinite(det)){
+            *a += (c->J[3] * dk - c->J[1] * dd) / det;
+            *b += (c->J[0] * dd - c->J[2] * dk) / det;
+        }
+    }else if(c->count == 2){
+        vk = c->k[1] - c->k[0];
+        vd = c->d[1] - c->d[0];
+        if(fabs(vk * dd - vd * dk) <= 1e-12 * (fabs(vk) + fabs(vd)) &&
+            vk * vk + vd * vd > 0)
+        {
+            t = (dk * vk + dd * vd) / (vk * vk + vd * vd);
+            *a += t * (c->a[1] - c->a[0]);
+            *b += t * (c->b[1] - c->b[0]);
+        }
+    }
+
+    return on_branch(c, *a, *b);
+}
+
+
+
+/*
+ * Adds a solved point to the chain. The jacobian of the solver is taken
+ * only if the point was solved by the newton method
+ */
+static void push_chain(struct chain *c, struct worker *w, double a, double b,
+    int newton)
+{
+    int i;
+
+    if(c->count == 2){
+        c->k[0] = c->k[1];
+        c->d[0] = c->d[1];
+        c->a[0] = c->a[1];
+        c->b[0] = c->b[1];
+    }else{
+        c->count++;
+    }
+
+    i = c->count - 1;
+    c->k[i] = w->params.k;
+    c->d[i] = w->params.d;
+    c->a[i] = a;
+    c->b[i] = b;
+
+    c->has_jacobian = newton && w->fdf_solver != NULL;
+    if(c->has_jacobian){
+        c->J[0] = gsl_matrix_get(w->fdf_solver->J, 0, 0);
+        c->J[1] = gsl_matrix_get(w->fdf_solver->J, 0, 1);
+        c->J[2] = gsl_matrix_get(w->fdf_solver->J, 1, 0);
+        c->J[3] = gsl_matrix_get(w->fdf_solver->J, 1, 1);
+    }
+}
+
+
+
+/*
+ * Buffers the telemetry record of the solved point, writing the buffer
+ * out when it is full
+ */
+static void record_point(struct worker *w, int index, int status,
+    long calls, double time)
+{
+    struct problem_info *p = w->p;
+    struct point_record *r = w->records + w->record_count;
+
+    r->row = index / p->d_grid.count;
+    r->col = index % p->d_grid.count;
+    r->k = get_row_k(p, r->row);
+    r->d = p->d_grid.origin + r->col * p->d_grid.step;
+    r->origin = w->params.grid.origin;
+    r->residual = w->residual;
+    r->time = time;
+    r->calls = calls;
+    r->iterations = w->iterations;
+    r->status = status;
+
+    if(++(w->record_count) == TELEMETRY_BLOCK){
+        telemetry_put(p->telemetry, w->records, w->record_count);
+        w->record_count = 0;
+    }
+}
+
+
+
+/*
+ * Solves the current target of the worker. The solution is interpolated
+ * from the inverse table if it covers the target, and polished by a few
+ * newton steps if asked. Otherwise, if the chain is given, the begin
+ * solution is predicted from it, and get_begin is used only if the
+ * prediction fails or leads to another branch
+ */
+static int solve_current(struct worker *w, double *a, double *b,
+    struct chain *c)
+{
+    struct problem_info *p = w->p;
+    double beg_a;
+    double beg_b;
+    int status = GSL_FAILURE;
+    int newton = 1;
 
-    for(i = 0; i < p->k_grid.count; i++){
-        d = p->d_grid.origin;
+    w->iterations = 0;
+    w->residual = NAN;
+
+#   ifdef DEBUG
+    printf("Space: [%lf; %lf]\n", w->params.grid.origin,
+        w->params.grid.origin + w->params.grid.step * w->params.grid.count);
+#   endif
+
+    if(p->table != NULL && table_lookup(p->table, w->params.k,
+        sqrt(w->params.d), &beg_a, &beg_b) == 0)
+    {
+        *a = beg_a;
+        *b = beg_b;
+        status = GSL_SUCCESS;
+        newton = p->polish > 0;
+        if(p->polish > 0){
+            status = find_root(w, p->polish, beg_a, beg_b, a, b);
+            if(status == GSL_CONTINUE){
+                status = GSL_SUCCESS;
+            }
+        }
+    }
+
+    if(status != GSL_SUCCESS && c != NULL &&
+        predict(c, &(w->params), &beg_a, &beg_b))
+    {
+        status = find_root(w, p->iter_count, beg_a, beg_b, a, b);
+        if(status == GSL_SUCCESS && !on_branch(c, *a, *b)){
+            status = GSL_FAILURE;
+        }
+    }
+
+    if(status != GSL_SUCCESS){
+        get_begin(p, w->params.d, w->params.k, &beg_a, &beg_b);
+        status = find_root(w, p->iter_count, beg_a, beg_b, a, b);
+    }
+
+    if(c != NULL){
+        if(status == GSL_SUCCESS){
+            push_chain(c, w, *a, *b, newton);
+        }else{
+            c->count = 0;
+        }
+    }
+
+    return status;
+}
+
+
+
+/*
+ * Solves a grid point
+ */
+static void solve_point(struct worker *w, struct result *res, int index,
+    struct chain *c)
+{
+    struct problem_info *p = w->p;
+    long calls = w->params.calls;
+    double start = p->telemetry != NULL ? get_wall_time() : 0.0;
+    int status;
+
+    set_point(p, index, &(w->params));
+    status = solve_current(w, res->a.storage + (index - w->offset),
+        res->b.storage + (index - w->offset), c);
+
+    if(p->telemetry != NULL){
+        record_point(w, index, status, w->params.calls - calls,
+            get_wall_time() - start);
+    }
+}
+
+
+
+int solve_target(struct worker *w, double k, double d, double *a,
+    double *b)
+{
+    w->params.k = k;
+    w->params.d = d * d;
+
+    return solve_current(w, a, b, NULL);
+}
+
+
+
+/*
+ * Solves a band of grid rows in the serpentine order, so every point
+ * follows its grid neighbour
+ */
+static void solve_band(struct worker *w, struct sweep *s, int band)
+{
+    struct problem_info *p = w->p;
+    struct result *res = s->res;
+    struct chain c;
+    int first = s->first + band * BAND_ROWS;
+    int last = first + BAND_ROWS < s->last ? first + BAND_ROWS : s->last;
+    int i;
+    int j;
+
+    c.count = 0;
+    for(i = first; i < last; i++){
         for(j = 0; j < p->d_grid.count; j++){
-            params.k = k;
-            params.d = d * d;
-
-#           ifdef DEBUG
-            printf("Space: [%lf; %lf]\n", params.buffer.grid.origin,
-                params.buffer.grid.origin + params.buffer.grid.step *
-                params.buffer.grid.count);
-#           endif
-
-            get_begin(p, params.d, params.k, &a, &b); 
-            find_root_f(
-                res.a.storage + i * p->d_grid.count + j,
-                res.b.storage + i * p->d_grid.count + j,
-                solver,
-                &f,
-                p->iter_count,
-                p->eps,
-                a,
-                b
-            );
-            printf(
-                "Input: (k = %lf, d = %lf)\n"
-                "Solution: (a = %lf, b = %lf)\n\n",
-                k,
-                params.d,
-                res.a.storage[i * p->d_grid.count + j],
-                res.b.storage[i * p->d_grid.count + j]
-            );
-
-            d += p->d_grid.step;
+            solve_point(w, res, i * p->d_grid.count +
+                ((i - first) % 2 == 0 ? j : p->d_grid.count - 1 - j), &c);
+        }
+    }
+}
+
+
+
+/*
+ * Measures the cost of the solved point by its kernel integrations. The
+ * adaptive rules place nodes over the integration width, so their
+ * integrations are weighted by the origin distance
+ */
+static double get_cost(const struct worker *w, long calls)
+{
+    double cost = calls > 0 ? calls : 1;
+
+    if(w->params.quad->type != QUAD_SIMPSON){
+        cost *= 1 + fabs(w->params.grid.origin);
+    }
+
+    return cost;
+}
+
+
+
+/*
+ * Solving thread
+ */
+static void *run_worker(void *arg)
+{
+    struct sweep *s = (struct sweep *)arg;
+    struct worker w;
+    long calls;
+    int queue = 0;
+    int task;
+
+    init_worker(&w, s->p, s->accuracy);
+    w.offset = s->first * s->p->d_grid.count;
+
+    if(s->queues != NULL){
+        pthread_mutex_lock(&(s->lock));
+        queue = s->next_queue++;
+        pthread_mutex_unlock(&(s->lock));
+    }
+
+    while((task = s->queues != NULL
+        ? take_task(s, queue)
+        : next_task(s)) >= 0)
+    {
+        if(s->p->continuation){
+            solve_band(&w, s, task);
+        }else{
+            calls = w.params.calls;
+            solve_point(&w, s->res, w.offset + task, NULL);
+            if(s->costs != NULL){
+                s->costs[task] = get_cost(&w, w.params.calls - calls);
+            }
         }
+    }
+
+    pthread_mutex_lock(&(s->lock));
+    s->res->calls += w.params.calls;
+    pthread_mutex_unlock(&(s->lock));
+
+    free_worker(&w);
+
+    return NULL;
+}
+
+
+
+int set_kernel(struct problem_info *p, char kern_type)
+{
+    p->kern_type = kern_type;
+    if(kern_type == KURTIC){
+        p->f = kurtic_f;
+        p->df = kurtic_df;
+        p->fdf = kurtic_fdf;
+    }else if(kern_type == RGARDEN){
+        p->f = rgarden_f;
+        p->df = rgarden_df;
+        p->fdf = rgarden_fdf;
+    }else if(kern_type == POLYEXP){
+        p->f = polyexp_f;
+        p->df = polyexp_df;
+        p->fdf = polyexp_fdf;
+    }else{
+        return 1;
+    }
+
+    return 0;
+}
+
 
-        k += p->k_grid.step;
+
+/*
+ * Runs the sweep by the given count of threads
+ */
+static void run_threads(struct sweep *s, int count)
+{
+    pthread_t *threads = malloc(sizeof(pthread_t) * count);
+    int i;
+
+    s->next = 0;
+    s->next_queue = 0;
+
+    /* the main thread is one of the workers */
+    for(i = 1; i < count; i++){
+        pthread_create(threads + i, NULL, &run_worker, s);
     }
 
-    free(params.buffer.storage);
-    gsl_multiroot_fsolver_free(solver);
+    run_worker(s);
 
-    return res;
+    for(i = 1; i < count; i++){
+        pthread_join(threads[i], NULL);
+    }
+
+    free(threads);
+}
+
+
+
+/*
+ * Holds a task with its predicted cost
+ */
+struct task_cost{
+    double cost;
+    int task;
+};
+
+static int compare_costs(const void *x, const void *y)
+{
+    const struct task_cost *cx = (const struct task_cost *)x;
+    const struct task_cost *cy = (const struct task_cost *)y;
+
+    if(cx->cost != cy->cost){
+        return cx->cost < cy->cost ? 1 : -1;
+    }
+
+    return cx->task - cy->task;
+}
+
+
+
+/*
+ * Finds the pilot row or column nearest to the index
+ */
+static int get_pilot(int index, int count)
+{
+    int pilot = (index + PILOT_STEP / 2) / PILOT_STEP * PILOT_STEP;
+    int last = (count - 1) / PILOT_STEP * PILOT_STEP;
+
+    return pilot < last ? pilot : last;
+}
+
+
+
+/*
+ * Runs the sweep of grid points by the cost model. The pilot points are
+ * solved first to measure the costs over the plane, then the other points
+ * are given the cost of the nearest pilot point and dealt to the thread
+ * queues by descending cost, so expensive regions are started first and
+ * the tail of the sweep is made of cheap points, stolen by idle threads
+ */
+static void run_scheduled(struct sweep *s, int count)
+{
+    int rows = s->last - s->first;
+    int cols = s->p->d_grid.count;
+    double *costs = malloc(sizeof(double) * s->count);
+    int *pilots = malloc(sizeof(int) * s->count);
+    struct task_cost *sorted = malloc(sizeof(struct task_cost) * s->count);
+    struct task_queue *queues = malloc(sizeof(struct task_queue) * count);
+    int pilot_count = 0;
+    int sorted_count = 0;
+    int i;
+    int j;
+    int n;
+
+    for(i = 0; i < rows; i += PILOT_STEP){
+        for(j = 0; j < cols; j += PILOT_STEP){
+            pilots[pilot_count++] = i * cols + j;
+        }
+    }
+
+    s->order = pilots;
+    s->costs = costs;
+    s->count = pilot_count;
+    run_threads(s, count);
+
+    for(n = 0; n < rows * cols; n++){
+        i = n / cols;
+        j = n % cols;
+        if(i % PILOT_STEP != 0 || j % PILOT_STEP != 0){
+            sorted[sorted_count].cost =
+                costs[get_pilot(i, rows) * cols + get_pilot(j, cols)];
+            sorted[sorted_count].task = n;
+            sorted_count++;
+        }
+    }
+
+    qsort(sorted, sorted_count, sizeof(struct task_cost), &compare_costs);
+
+    for(i = 0; i < count; i++){
+        pthread_mutex_init(&(queues[i].lock), NULL);
+        queues[i].tasks = malloc(sizeof(int) * (sorted_count / count + 1));
+        queues[i].head = 0;
+        queues[i].tail = 0;
+    }
+
+    for(n = 0; n < sorted_count; n++){
+        queues[n % count].tasks[queues[n % count].tail++] = sorted[n].task;
+    }
+
+    s->order = NULL;
+    s->costs = NULL;
+    s->queues = queues;
+    s->queue_count = count;
+    run_threads(s, count);
+    s->queues = NULL;
+
+    for(i = 0; i < count; i++){
+        pthread_mutex_destroy(&(queues[i].lock));
+        free(queues[i].tasks);
+    }
+
+    free(queues);
+    free(sorted);
+    free(pilots);
+    free(costs);
+}
+
+
+
+void solve_rows(struct problem_info *p, int first, int rows,
+    struct result *res)
+{
+    int count = p->thread_count > 1 ? p->thread_count : 1;
+    struct sweep s;
+
+    s.p = p;
+    s.res = res;
+    s.accuracy = get_accuracy(p);
+    s.first = first;
+    s.last = first + rows;
+    s.count = p->continuation
+        ? (rows + BAND_ROWS - 1) / BAND_ROWS
+        : rows * p->d_grid.count;
+    s.order = NULL;
+    s.costs = NULL;
+    s.queues = NULL;
+    s.queue_count = 0;
+    pthread_mutex_init(&(s.lock), NULL);
+
+    /* continuation bands are ordered, so only points are scheduled */
+    if(count > 1 && !p->continuation){
+        run_scheduled(&s, count);
+    }else{
+        run_threads(&s, count);
+    }
+
+    pthread_mutex_destroy(&(s.lock));
 }
 
 
 
 struct result solve(struct problem_info *p)
 {
-    if(p->kern_type == KURTIC){
-        return solve_fdf(p);
+    struct result res;
+
+    init_result_info(&res, p, p->k_grid.count);
+    solve_rows(p, 0, p->k_grid.count, &res);
+
+    return res;
+}
+
+
+
+int get_chunk_rows(const struct problem_info *p)
+{
+    int rows = CHUNK_POINTS / p->d_grid.count;
+
+    /* continuation bands must not cross chunks */
+    if(p->continuation){
+        rows -= rows % BAND_ROWS;
+        if(rows < BAND_ROWS * p->thread_count){
+            rows = BAND_ROWS * p->thread_count;
+        }
+    }else if(rows < 1){
+        rows = 1;
+    }
+
+    return rows < p->k_grid.count ? rows : p->k_grid.count;
+}
+
+
+
+/*
+ * Differentiates the node derivative along the lattice by the central
+ * difference, or by the one-sided one at borders and unsolved neighbours.
+ * Returns NAN if both neighbours are unsolved
+ */
+static double get_cross(const struct table_node *nodes, int index,
+    int stride, int pos, int count, int part, int deriv, double step)
+{
+    const double *lo = NULL;
+    const double *hi = NULL;
+    const double *v = (part == 0 ? nodes[index].a : nodes[index].b);
+    double dist = 0.0;
+
+    if(pos > 0){
+        lo = part == 0 ? nodes[index - stride].a : nodes[index - stride].b;
+        if(isnan(lo[deriv])){
+            lo = NULL;
+        }
     }
 
-    return solve_f(p);
+    if(pos < count - 1){
+        hi = part == 0 ? nodes[index + stride].a : nodes[index + stride].b;
+        if(isnan(hi[deriv])){
+            hi = NULL;
+        }
+    }
+
+    if(lo == NULL && hi == NULL){
+        return NAN;
+    }
+
+    if(lo == NULL){
+        lo = v;
+    }else{
+        dist += step;
+    }
+
+    if(hi == NULL){
+        hi = v;
+    }else{
+        dist += step;
+    }
+
+    return (hi[deriv] - lo[deriv]) / dist;
+}
+
+
+
+struct table_node *make_table_nodes(struct problem_info *p,
+    const struct result *res)
+{
+    int count = p->k_grid.count * p->d_grid.count;
+    struct table_node *nodes = malloc(sizeof(struct table_node) * count);
+    gsl_vector *x = gsl_vector_alloc(2);
+    gsl_vector *f = gsl_vector_alloc(2);
+    gsl_matrix *J = gsl_matrix_alloc(2, 2);
+    struct params params;
+    double s;
+    double det;
+    double by_d;
+    double by_k;
+    int index;
+    int i;
+    int j;
+    int part;
+
+    if(nodes == NULL){
+        return NULL;
+    }
+
+    params.grid = p->space_grid;
+    params.space_dim = p->space_dim;
+    params.accuracy = get_accuracy(p);
+    params.quad = p->quad;
+    params.prefetch = 0;
+    clear_cache(&params);
+
+    /* derivatives by the implicit function theorem: J^-1 */
+    for(index = 0; index < count; index++){
+        set_point(p, index, &params);
+        s = sqrt(params.d);
+        nodes[index].a[0] = res->a.storage[index];
+        nodes[index].b[0] = res->b.storage[index];
+        gsl_vector_set(x, 0, nodes[index].a[0]);
+        gsl_vector_set(x, 1, nodes[index].b[0]);
+
+        det = NAN;
+        if(p->fdf(x, &params, f, J) == GSL_SUCCESS &&
+            gsl_multiroot_test_residual(f, p->eps) == GSL_SUCCESS)
+        {
+            det = gsl_matrix_get(J, 0, 0) * gsl_matrix_get(J, 1, 1) -
+                gsl_matrix_get(J, 0, 1) * gsl_matrix_get(J, 1, 0);
+        }
+
+        if(det == 0 || !isfinite(det)){
+            for(i = 0; i < 4; i++){
+                nodes[index].a[i] = nodes[index].b[i] = NAN;
+            }
+            continue;
+        }
+
+        /* d/ds = 2s d/dd for the standard deviation s */
+        nodes[index].a[1] = gsl_matrix_get(J, 1, 1) / det;
+        nodes[index].a[2] = -gsl_matrix_get(J, 0, 1) / det * 2 * s;
+        nodes[index].b[1] = -gsl_matrix_get(J, 1, 0) / det;
+        nodes[index].b[2] = gsl_matrix_get(J, 0, 0) / det * 2 * s;
+    }
+
+    /* cross derivatives as the mean of both difference directions */
+    for(index = 0; index < count; index++){
+        i = index / p->d_grid.count;
+        j = index % p->d_grid.count;
+
+        for(part = 0; part < 2 && !isnan(nodes[index].a[0]); part++){
+            by_d = get_cross(nodes, index, 1, j, p->d_grid.count, part, 1,
+                p->d_grid.step);
+            by_k = get_cross(nodes, index, p->d_grid.count, i,
+                p->k_grid.count, part, 2, p->k_grid.step);
+            s = isnan(by_d) ? by_k : isnan(by_k) ? by_d : 0.5 * (by_d + by_k);
+
+            if(part == 0){
+                nodes[index].a[3] = isnan(s) ? 0.0 : s;
+            }else{
+                nodes[index].b[3] = isnan(s) ? 0.0 : s;
+            }
+        }
+    }
+
+    gsl_vector_free(x);
+    gsl_vector_free(f);
+    gsl_matrix_free(J);
+
+    return nodes;
 }
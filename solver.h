@@ -1,8 +1,10 @@
 #ifndef SOLVER_MODULE_H
 #define SOLVER_MODULE_H
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <pthread.h>
 
 #include <gsl/gsl_errno.h>
 #include <gsl/gsl_math.h>
@@ -10,6 +12,9 @@
 
 #include "kernels.h"
 #include "vector.h"
+#include "quadrature.h"
+#include "table.h"
+#include "telemetry.h"
 
 typedef int (*FFunc)(const gsl_vector *, void *, gsl_vector *);
 typedef int (*DFunc)(const gsl_vector *, void *, gsl_matrix *);
@@ -17,25 +22,30 @@ typedef int (*FDFunc)(const gsl_vector *, void *, gsl_vector *,
     gsl_matrix *);
 
 /*
- * Avaliable kernel types
- */
-#define KURTIC 'k'
-#define RGARDEN 'r'
-#define POLYEXP 'p'
-
-
-/*
- * Holds info about problem initial data
+ * Holds info about problem initial data. Grid row i has the excess of the
+ * sweep row row_first + i row_stride, so a shard of the sweep keeps the
+ * origin and the step of the sweep excess grid
  */
 struct problem_info{
     struct linspace k_grid;         /* grid of kurtosis excess */
     struct linspace d_grid;         /* grid of dispersion */
+    int row_first;                  /* sweep row of the first grid row */
+    int row_stride;                 /* sweep rows between grid rows */
 
     struct linspace space_grid;     /* grid of space */
+    int space_dim;                  /* space dimension of the kernel */
     int iter_count;                 /* iteration max count */
     double eps;                     /* precision */
+    int thread_count;               /* count of solving threads */
+    int continuation;               /* whether to predict begin solutions */
 
     char kern_type;                 /* kernel type */
+    int accuracy;                   /* kernel evaluation accuracy tier */
+    struct quadrature *quad;        /* quadrature rule of the moments */
+
+    const struct table *table;      /* inverse table or NULL */
+    int polish;                     /* newton steps after table lookups */
+    struct telemetry *telemetry;    /* point telemetry sink or NULL */
 
     FFunc f;                        /* function GSL representation */
     DFunc df;                       /* derivative GSL representation */
@@ -50,13 +60,101 @@ struct problem_info{
 struct result{
     struct vector_func a;
     struct vector_func b;
+    long calls;                     /* count of kernel integrations */
+};
+
+
+
+/*
+ * Holds the solving state of one thread
+ */
+struct worker{
+    struct problem_info *p;             /* problem to solve */
+    gsl_multiroot_fdfsolver *fdf_solver; /* derivative solver or NULL */
+    gsl_multiroot_fsolver *f_solver;    /* simple solver or NULL */
+    gsl_multiroot_function_fdf fdf;     /* fdf GSL representation */
+    gsl_multiroot_function f;           /* f GSL representation */
+    gsl_vector *x;                      /* begin solution */
+    struct params params;               /* kernel calculation params */
+    int offset;                         /* grid index of the first result */
+
+    struct point_record *records;       /* telemetry buffer or NULL */
+    int record_count;                   /* count of buffered records */
+    int iterations;                     /* newton iterations of the point */
+    double residual;                    /* last newton residual */
 };
 
 
 
+/*
+ * Returns the excess kurtosis of the grid row, computed from the sweep
+ * row, so a shard gets the same values as the whole sweep
+ */
+double get_row_k(const struct problem_info *p, int row);
+
+/*
+ * Chooses the accuracy tier of kernel evaluation. A rough tier is used
+ * only if its error is provably below the half of the precision on the
+ * whole grid: with relative kernel error e the dispersion error is below
+ * 2e / (1 - e) d and the excess error is below 4e / (1 - e)^2 (k + 3).
+ * Otherwise the full tier is used
+ */
+int get_accuracy(const struct problem_info *p);
+
+/*
+ * Allocates the result storage of the given count of grid rows
+ */
+void init_result_info(struct result *res, const struct problem_info *p,
+    int rows);
+
 /*
  * Solves the problem
  */
 struct result solve(struct problem_info *p);
 
+/*
+ * Solves the grid rows [first, first + rows) into the result storage of
+ * that many rows. The kernel integration count is added to the result
+ */
+void solve_rows(struct problem_info *p, int first, int rows,
+    struct result *res);
+
+/*
+ * Sets the kernel type and its GSL representations. Returns 1 if the type
+ * is unknown
+ */
+int set_kernel(struct problem_info *p, char kern_type);
+
+/*
+ * Initializes the solving state of a thread. The derivative method is used
+ * if the kernel has the jacobian, then f evaluations prefetch the jacobian
+ * integrals, as the solver asks the jacobian at the accepted iterates
+ */
+void init_worker(struct worker *w, struct problem_info *p, int accuracy);
+
+/*
+ * Frees the solving state, writing out its telemetry records
+ */
+void free_worker(struct worker *w);
+
+/*
+ * Solves the single target of the excess kurtosis k and the standard
+ * deviation d with the worker. Returns the GSL status
+ */
+int solve_target(struct worker *w, double k, double d, double *a,
+    double *b);
+
+/*
+ * Returns the count of grid rows solved at once in the streaming mode, so
+ * that the result storage of a chunk does not depend on the grid size
+ */
+int get_chunk_rows(const struct problem_info *p);
+
+/*
+ * Makes inverse table nodes from the solution of the problem. Returns
+ * NULL if the memory is exhausted
+ */
+struct table_node *make_table_nodes(struct problem_info *p,
+    const struct result *res);
+
 #endif
@@ -0,0 +1,228 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "surface.h"
+
+/*
+ * Maximal length of a pair table line and of a solver command
+ */
+#define LINE_LENGTH 512
+
+/*
+ * Holds a pair table row with its solution
+ */
+struct surface_row{
+    double v[8];                    /* km kw dm dw s0m s1m s0w s1w */
+    double n;                       /* solved density */
+    int empty;                      /* whether the line is empty */
+};
+
+/*
+ * Holds a block of rows shared by the solving threads
+ */
+struct surface_block{
+    const struct surface_info *info;
+    struct surface_row *rows;
+    int count;                      /* count of rows */
+
+    pthread_mutex_t lock;           /* guards the next row */
+    int next;                       /* next unsolved row */
+};
+
+
+
+double stub_pair_solver(const double *k, const struct surface_model *m,
+    void *ctx)
+{
+    return (m->b - m->d) / m->s;
+}
+
+
+
+double command_pair_solver(const double *k, const struct surface_model *m,
+    void *ctx)
+{
+    char command[LINE_LENGTH];
+    FILE *pipe;
+    double n = NAN;
+
+    snprintf(command, sizeof(command), "%s -kK %lf %lf %lf %lf",
+        (const char *)ctx, k[0], k[1], k[2], k[3]);
+
+    pipe = popen(command, "r");
+    if(pipe == NULL){
+        return NAN;
+    }
+
+    if(fscanf(pipe, "%lf", &n) != 1){
+        n = NAN;
+    }
+
+    if(pclose(pipe) != 0){
+        n = NAN;
+    }
+
+    return n;
+}
+
+
+
+/*
+ * Reads up to SURFACE_BLOCK rows. Returns 1 if a line is not a pair table
+ * row
+ */
+static int read_block(FILE *in, struct surface_row *rows, int *count)
+{
+    char line[LINE_LENGTH];
+    struct surface_row *r;
+    int pos;
+
+    *count = 0;
+    while(*count < SURFACE_BLOCK && fgets(line, sizeof(line), in) != NULL){
+        r = rows + *count;
+        r->empty = line[strspn(line, " \t\r\n")] == '\0';
+        r->n = NAN;
+
+        if(!r->empty && (sscanf(line, "%lf %lf %lf %lf %lf %lf %lf %lf %n",
+            r->v, r->v + 1, r->v + 2, r->v + 3, r->v + 4, r->v + 5,
+            r->v + 6, r->v + 7, &pos) != 8 || line[pos] != '\0'))
+        {
+            return 1;
+        }
+
+        (*count)++;
+    }
+
+    return 0;
+}
+
+
+
+/*
+ * Solving thread
+ */
+static void *run_solver(void *arg)
+{
+    struct surface_block *b = (struct surface_block *)arg;
+    const struct surface_info *info = b->info;
+    struct surface_row *r;
+    int index;
+
+    for(;;){
+        pthread_mutex_lock(&(b->lock));
+        index = b->next < b->count ? b->next++ : -1;
+        pthread_mutex_unlock(&(b->lock));
+
+        if(index < 0){
+            break;
+        }
+
+        r = b->rows + index;
+        if(!r->empty){
+            r->n = info->solver(r->v + 4, &(info->model), info->ctx);
+        }
+    }
+
+    return NULL;
+}
+
+
+
+/*
+ * Solves the block by the thread pool
+ */
+static void solve_block(struct surface_block *b)
+{
+    int count = b->info->thread_count < b->count
+        ? b->info->thread_count
+        : b->count;
+    pthread_t *threads = malloc(sizeof(pthread_t) * (count > 1 ? count : 1));
+    int i;
+
+    b->next = 0;
+
+    /* the main thread is one of the solvers */
+    for(i = 1; i < count; i++){
+        pthread_create(threads + i, NULL, &run_solver, b);
+    }
+
+    run_solver(b);
+
+    for(i = 1; i < count; i++){
+        pthread_join(threads[i], NULL);
+    }
+
+    free(threads);
+}
+
+
+
+/*
+ * Writes the solved block
+ */
+static int write_block(FILE *out, const struct surface_block *b,
+    long *failed)
+{
+    const struct surface_model *m = &(b->info->model);
+    double meanfield = (m->b - m->d) / m->s;
+    const struct surface_row *r;
+    double n;
+    int i;
+
+    for(i = 0; i < b->count; i++){
+        r = b->rows + i;
+        if(r->empty){
+            if(fputc('\n', out) == EOF){
+                return 1;
+            }
+            continue;
+        }
+
+        n = r->n;
+        if(isnan(n)){
+            n = SURFACE_NAN_VALUE;
+            (*failed)++;
+        }
+
+        if(fprintf(out, "%lf %lf %lf %lf %lf\n", r->v[0], r->v[1], r->v[2],
+            r->v[3], n / meanfield) < 0)
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+
+int solve_surface(FILE *in, FILE *out, const struct surface_info *info,
+    long *failed)
+{
+    struct surface_block b;
+    int status = 0;
+
+    b.info = info;
+    b.rows = malloc(sizeof(struct surface_row) * SURFACE_BLOCK);
+    if(b.rows == NULL){
+        return 1;
+    }
+
+    pthread_mutex_init(&(b.lock), NULL);
+    *failed = 0;
+
+    do{
+        status = read_block(in, b.rows, &(b.count));
+        if(status == 0 && b.count > 0){
+            solve_block(&b);
+            status = write_block(out, &b, failed);
+        }
+    }while(status == 0 && b.count == SURFACE_BLOCK);
+
+    pthread_mutex_destroy(&(b.lock));
+    free(b.rows);
+
+    return status;
+}
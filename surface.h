@@ -0,0 +1,70 @@
+#ifndef SURFACE_MODULE_H
+#define SURFACE_MODULE_H
+
+#include <stdio.h>
+
+/*
+ * Count of pair table rows read, solved and written at once
+ */
+#define SURFACE_BLOCK 4096
+
+/*
+ * Density assumed for points where the pair solver fails
+ */
+#define SURFACE_NAN_VALUE 10.0
+
+/*
+ * Parameters of the model the pairs are solved in
+ */
+struct surface_model{
+    double b;                       /* birth rate */
+    double d;                       /* death rate */
+    double s;                       /* competition rate */
+    int dim;                        /* space dimension */
+};
+
+/*
+ * Pair solver: finds the equilibrium density N of the model with the
+ * kernel parameters k = [s0m s1m s0w s1w]. Returns NAN if it fails. It is
+ * called by several threads at once
+ */
+typedef double (*PairSolver)(const double *k, const struct surface_model *m,
+    void *ctx);
+
+/*
+ * Holds info about a surface run
+ */
+struct surface_info{
+    PairSolver solver;              /* pair solver */
+    void *ctx;                      /* pair solver context */
+    struct surface_model model;     /* model parameters */
+    int thread_count;               /* count of solving threads */
+};
+
+
+
+/*
+ * Stub pair solver for testing: the mean-field density (b - d) / s
+ */
+double stub_pair_solver(const double *k, const struct surface_model *m,
+    void *ctx);
+
+/*
+ * Pair solver running the external program given as the context command.
+ * The program is called with the arguments -kK s0m s1m s0w s1w appended
+ * and must print N
+ */
+double command_pair_solver(const double *k, const struct surface_model *m,
+    void *ctx);
+
+/*
+ * Streams the pair table rows [km kw dm dw s0m s1m s0w s1w] from the
+ * input and writes the surface rows [km kw dm dw N / Nmf] in the same
+ * order, where Nmf is the mean-field density. Empty lines are kept.
+ * Points where the solver fails get SURFACE_NAN_VALUE and are counted in
+ * failed. Returns 0 on success, 1 on invalid input or output error
+ */
+int solve_surface(FILE *in, FILE *out, const struct surface_info *info,
+    long *failed);
+
+#endif
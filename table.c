@@ -0,0 +1,222 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "table.h"
+
+/*
+ * Cubic Hermite basis: h[0], h[1] weight the values at the ends, h[2],
+ * h[3] weight the derivatives
+ */
+static void hermite_basis(double t, double *h)
+{
+    double tt = t * t;
+    double ttt = tt * t;
+
+    h[0] = 2 * ttt - 3 * tt + 1;
+    h[1] = -2 * ttt + 3 * tt;
+    h[2] = ttt - 2 * tt + t;
+    h[3] = ttt - tt;
+}
+
+
+
+/*
+ * Bicubic Hermite interpolation of one parameter over the cell corners
+ * c[0] = (i, j), c[1] = (i + 1, j), c[2] = (i, j + 1), c[3] = (i + 1, j + 1)
+ */
+static double interpolate(const double *c[4], const double *hu,
+    const double *hv, double hk, double hd)
+{
+    double sum = 0.0;
+    int n;
+    int iu;
+    int iv;
+
+    for(n = 0; n < 4; n++){
+        iu = n % 2;
+        iv = n / 2;
+        sum += c[n][0] * hu[iu] * hv[iv] +
+            c[n][1] * hk * hu[2 + iu] * hv[iv] +
+            c[n][2] * hd * hu[iu] * hv[2 + iv] +
+            c[n][3] * hk * hd * hu[2 + iu] * hv[2 + iv];
+    }
+
+    return sum;
+}
+
+
+
+/*
+ * Finds the lattice cell of the coordinate. Returns -1 if it is outside
+ */
+static int find_cell(double x, double origin, double step, int count,
+    double *t)
+{
+    double pos = (x - origin) / step;
+    int i;
+
+    if(!(pos >= 0 && pos <= count - 1)){
+        return -1;
+    }
+
+    i = (int)pos;
+    if(i > count - 2){
+        i = count - 2;
+    }
+
+    *t = pos - i;
+
+    return i;
+}
+
+
+
+int table_write(
+    const char *file_name,
+    char kern_type,
+    const struct linspace *k_grid,
+    const struct linspace *d_grid,
+    const struct table_node *nodes
+)
+{
+    struct table_header h;
+    size_t count = (size_t)k_grid->count * d_grid->count;
+    FILE *out = fopen(file_name, "wb");
+    int status = 0;
+
+    if(out == NULL){
+        return 1;
+    }
+
+    memset(&h, 0, sizeof(h));
+    h.magic = TABLE_MAGIC;
+    h.version = TABLE_VERSION;
+    h.k_origin = k_grid->origin;
+    h.k_step = k_grid->step;
+    h.k_count = k_grid->count;
+    h.d_origin = d_grid->origin;
+    h.d_step = d_grid->step;
+    h.d_count = d_grid->count;
+    h.kern_type = kern_type;
+
+    if(fwrite(&h, sizeof(h), 1, out) != 1 ||
+        fwrite(nodes, sizeof(struct table_node), count, out) != count)
+    {
+        status = 1;
+    }
+
+    if(fclose(out) != 0){
+        status = 1;
+    }
+
+    return status;
+}
+
+
+
+struct table *table_open(const char *file_name)
+{
+    struct table *t;
+    struct stat st;
+    const struct table_header *h;
+    void *map;
+    int fd = open(file_name, O_RDONLY);
+
+    if(fd < 0){
+        return NULL;
+    }
+
+    if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(*h)){
+        close(fd);
+        return NULL;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED){
+        return NULL;
+    }
+
+    h = (const struct table_header *)map;
+    if(h->magic != TABLE_MAGIC || h->version != TABLE_VERSION ||
+        h->k_count < 2 || h->d_count < 2 ||
+        (size_t)st.st_size != sizeof(*h) +
+            (size_t)h->k_count * h->d_count * sizeof(struct table_node))
+    {
+        munmap(map, st.st_size);
+        return NULL;
+    }
+
+    t = malloc(sizeof(struct table));
+    if(t == NULL){
+        munmap(map, st.st_size);
+        return NULL;
+    }
+
+    t->header = h;
+    t->nodes = (const struct table_node *)(h + 1);
+    t->size = st.st_size;
+
+    return t;
+}
+
+
+
+void table_close(struct table *t)
+{
+    if(t == NULL){
+        return;
+    }
+
+    munmap((void *)t->header, t->size);
+    free(t);
+}
+
+
+
+int table_lookup(const struct table *t, double k, double d, double *a,
+    double *b)
+{
+    const struct table_header *h = t->header;
+    const struct table_node *n[4];
+    const double *ca[4];
+    const double *cb[4];
+    double hu[4];
+    double hv[4];
+    double u = 0.0;
+    double v = 0.0;
+    int i = find_cell(k, h->k_origin, h->k_step, h->k_count, &u);
+    int j = find_cell(d, h->d_origin, h->d_step, h->d_count, &v);
+    int c;
+
+    if(i < 0 || j < 0){
+        return 1;
+    }
+
+    n[0] = t->nodes + (size_t)i * h->d_count + j;
+    n[1] = n[0] + h->d_count;
+    n[2] = n[0] + 1;
+    n[3] = n[1] + 1;
+
+    for(c = 0; c < 4; c++){
+        if(isnan(n[c]->a[0]) || isnan(n[c]->b[0])){
+            return 1;
+        }
+
+        ca[c] = n[c]->a;
+        cb[c] = n[c]->b;
+    }
+
+    hermite_basis(u, hu);
+    hermite_basis(v, hv);
+    *a = interpolate(ca, hu, hv, h->k_step, h->d_step);
+    *b = interpolate(cb, hu, hv, h->k_step, h->d_step);
+
+    return 0;
+}
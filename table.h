@@ -0,0 +1,84 @@
+#ifndef TABLE_MODULE_H
+#define TABLE_MODULE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vector.h"
+
+/*
+ * Table file identification
+ */
+#define TABLE_MAGIC 0x4254584bu     /* "KXTB" in little endian */
+#define TABLE_VERSION 1
+
+/*
+ * Table file header. The header is followed by lattice nodes in the order
+ * of the excess grid, then of the dispersion grid. Numbers are stored in
+ * the native byte order
+ */
+struct table_header{
+    uint32_t magic;
+    uint32_t version;
+    double k_origin;                /* excess kurtosis lattice */
+    double k_step;
+    double d_origin;                /* standard deviation lattice */
+    double d_step;
+    int32_t k_count;
+    int32_t d_count;
+    char kern_type;                 /* kernel type */
+    char reserved[7];
+};
+
+/*
+ * Solution at a lattice node with its derivatives for the bicubic
+ * interpolation: the value, d/dk, d/dd and d2/dkdd, where d is the
+ * standard deviation. Nodes without a solution hold NAN
+ */
+struct table_node{
+    double a[4];
+    double b[4];
+};
+
+/*
+ * Mapped table
+ */
+struct table{
+    const struct table_header *header;
+    const struct table_node *nodes;
+    size_t size;                    /* mapping length */
+};
+
+
+
+/*
+ * Writes the table of the nodes on the given lattice. Returns 0 on
+ * success
+ */
+int table_write(
+    const char *file_name,
+    char kern_type,
+    const struct linspace *k_grid,
+    const struct linspace *d_grid,
+    const struct table_node *nodes
+);
+
+/*
+ * Maps the table file. Returns NULL if the file is not a valid table
+ */
+struct table *table_open(const char *file_name);
+
+/*
+ * Unmaps the table
+ */
+void table_close(struct table *t);
+
+/*
+ * Interpolates the solution at the excess kurtosis k and the standard
+ * deviation d. Returns 0 on success, or 1 if the point is outside the
+ * lattice or its cell has unsolved nodes
+ */
+int table_lookup(const struct table *t, double k, double d, double *a,
+    double *b);
+
+#endif
@@ -0,0 +1,222 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <gsl/gsl_errno.h>
+
+#include "telemetry.h"
+
+/*
+ * Width of the longest histogram bar
+ */
+#define BAR_WIDTH 40
+
+
+
+double get_wall_time(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+
+
+struct telemetry *telemetry_open(const char *file_name, char format)
+{
+    struct telemetry *t;
+    uint32_t header[3] = {
+        TELEMETRY_MAGIC,
+        TELEMETRY_VERSION,
+        sizeof(struct point_record)
+    };
+
+    if(format != TELEMETRY_JSONL && format != TELEMETRY_BINARY){
+        return NULL;
+    }
+
+    t = calloc(1, sizeof(struct telemetry));
+    if(t == NULL){
+        return NULL;
+    }
+
+    t->format = format;
+    t->out = fopen(file_name, format == TELEMETRY_BINARY ? "wb" : "w");
+    if(t->out == NULL || (format == TELEMETRY_BINARY &&
+        fwrite(header, sizeof(header), 1, t->out) != 1))
+    {
+        if(t->out != NULL){
+            fclose(t->out);
+        }
+        free(t);
+        return NULL;
+    }
+
+    t->slowest.time = -1.0;
+    pthread_mutex_init(&(t->lock), NULL);
+
+    return t;
+}
+
+
+
+/*
+ * Writes the record as a JSON line. The residual is null if newton has
+ * not run
+ */
+static int put_json(FILE *out, const struct point_record *r)
+{
+    char residual[32];
+
+    if(isnan(r->residual)){
+        strcpy(residual, "null");
+    }else{
+        snprintf(residual, sizeof(residual), "%.6e", r->residual);
+    }
+
+    return fprintf(
+        out,
+        "{\"row\":%d,\"col\":%d,\"k\":%.10g,\"d\":%.10g,"
+        "\"iterations\":%d,\"residual\":%s,\"status\":%d,"
+        "\"calls\":%lld,\"origin\":%.10g,\"time\":%.6e}\n",
+        (int)r->row,
+        (int)r->col,
+        r->k,
+        r->d,
+        (int)r->iterations,
+        residual,
+        (int)r->status,
+        (long long)r->calls,
+        r->origin,
+        r->time
+    ) < 0;
+}
+
+
+
+/*
+ * Finds the histogram bins of the record
+ */
+static int get_iter_bin(int iterations)
+{
+    int bin = 0;
+
+    while(iterations > 0 && bin < TELEMETRY_BINS - 1){
+        iterations >>= 1;
+        bin++;
+    }
+
+    return bin;
+}
+
+static int get_time_bin(double time)
+{
+    double bound = 1e-6;
+    int bin = 0;
+
+    while(time >= bound && bin < TELEMETRY_BINS - 1){
+        bound *= 10;
+        bin++;
+    }
+
+    return bin;
+}
+
+
+
+void telemetry_put(struct telemetry *t, const struct point_record *r,
+    int count)
+{
+    int i;
+
+    pthread_mutex_lock(&(t->lock));
+
+    if(t->format == TELEMETRY_BINARY){
+        if(fwrite(r, sizeof(*r), count, t->out) != (size_t)count){
+            t->error = 1;
+        }
+    }else{
+        for(i = 0; i < count; i++){
+            t->error |= put_json(t->out, r + i);
+        }
+    }
+
+    for(i = 0; i < count; i++){
+        t->count++;
+        t->failed += r[i].status != GSL_SUCCESS;
+        t->calls += r[i].calls;
+        t->time += r[i].time;
+        t->iter_bins[get_iter_bin(r[i].iterations)]++;
+        t->time_bins[get_time_bin(r[i].time)]++;
+
+        if(r[i].time > t->slowest.time){
+            t->slowest = r[i];
+        }
+    }
+
+    pthread_mutex_unlock(&(t->lock));
+}
+
+
+
+/*
+ * Prints a histogram with bars scaled to the fullest bin
+ */
+static void print_histogram(FILE *out, const char *title,
+    const char *const *labels, const long *bins)
+{
+    long top = 1;
+    int i;
+    int j;
+
+    for(i = 0; i < TELEMETRY_BINS; i++){
+        if(bins[i] > top){
+            top = bins[i];
+        }
+    }
+
+    fprintf(out, "%s:\n", title);
+    for(i = 0; i < TELEMETRY_BINS; i++){
+        fprintf(out, "%8s %10ld ", labels[i], bins[i]);
+        for(j = 0; j < (bins[i] * BAR_WIDTH + top - 1) / top; j++){
+            fputc('#', out);
+        }
+        fputc('\n', out);
+    }
+}
+
+
+
+int telemetry_close(struct telemetry *t, FILE *summary)
+{
+    static const char *const iter_labels[TELEMETRY_BINS] = {
+        "0", "1", "2-3", "4-7", "8-15", "16-31", "32-63", "64+"
+    };
+    static const char *const time_labels[TELEMETRY_BINS] = {
+        "<1us", "<10us", "<100us", "<1ms", "<10ms", "<100ms", "<1s", "1s+"
+    };
+    int status;
+
+    if(t == NULL){
+        return 0;
+    }
+
+    fprintf(summary, "Points: %ld, unsolved: %ld, kernel integrations: %ld, "
+        "time: %.3lf s\n", t->count, t->failed, t->calls, t->time);
+    print_histogram(summary, "Newton iterations", iter_labels, t->iter_bins);
+    print_histogram(summary, "Wall time", time_labels, t->time_bins);
+
+    if(t->count > 0){
+        fprintf(summary, "Slowest point: (k = %lf, d = %lf), %.3e s, "
+            "%d iterations\n", t->slowest.k, t->slowest.d, t->slowest.time,
+            (int)t->slowest.iterations);
+    }
+
+    status = fclose(t->out) != 0 || t->error;
+    pthread_mutex_destroy(&(t->lock));
+    free(t);
+
+    return status;
+}
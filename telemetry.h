@@ -0,0 +1,92 @@
+#ifndef TELEMETRY_MODULE_H
+#define TELEMETRY_MODULE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/*
+ * Telemetry formats
+ */
+#define TELEMETRY_JSONL 'j'
+#define TELEMETRY_BINARY 'b'
+
+/*
+ * Binary telemetry identification. The header of the magic, the version
+ * and the record size is followed by point records in the native byte
+ * order
+ */
+#define TELEMETRY_MAGIC 0x4d4c4554u  /* "TELM" in little endian */
+#define TELEMETRY_VERSION 1
+
+/*
+ * Count of records buffered by a solving thread before they are written
+ */
+#define TELEMETRY_BLOCK 256
+
+/*
+ * Count of histogram bins. Iterations are binned by powers of two, wall
+ * times by decades from a microsecond
+ */
+#define TELEMETRY_BINS 8
+
+/*
+ * Solving record of a grid point
+ */
+struct point_record{
+    int32_t row;                    /* excess grid index */
+    int32_t col;                    /* dispersion grid index */
+    double k;                       /* excess kurtosis */
+    double d;                       /* standard deviation */
+    double origin;                  /* space grid origin */
+    double residual;                /* final residual, NAN without newton */
+    double time;                    /* wall time in seconds */
+    int64_t calls;                  /* count of kernel integrations */
+    int32_t iterations;             /* count of newton iterations */
+    int32_t status;                 /* final GSL status */
+};
+
+/*
+ * Telemetry sink shared by the solving threads
+ */
+struct telemetry{
+    FILE *out;                      /* side file */
+    char format;                    /* side file format */
+    int error;                      /* whether a write has failed */
+    pthread_mutex_t lock;           /* guards the file and the summary */
+
+    long count;                     /* count of recorded points */
+    long failed;                    /* count of unsolved points */
+    long calls;                     /* count of kernel integrations */
+    double time;                    /* total wall time */
+    long iter_bins[TELEMETRY_BINS]; /* histogram of iterations */
+    long time_bins[TELEMETRY_BINS]; /* histogram of wall times */
+    struct point_record slowest;    /* most expensive point */
+};
+
+
+
+/*
+ * Returns the monotonic wall clock in seconds
+ */
+double get_wall_time(void);
+
+/*
+ * Opens the telemetry side file of the given format. Returns NULL if the
+ * file cannot be written or the format is unknown
+ */
+struct telemetry *telemetry_open(const char *file_name, char format);
+
+/*
+ * Writes the records and adds them to the summary. Thread safe
+ */
+void telemetry_put(struct telemetry *t, const struct point_record *r,
+    int count);
+
+/*
+ * Prints the summary histograms, closes the side file and frees the
+ * sink. Returns 0 if all records have been written
+ */
+int telemetry_close(struct telemetry *t, FILE *summary);
+
+#endif
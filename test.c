@@ -1,13 +1,18 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <unistd.h>
 #include <gsl/gsl_errno.h>
 #include <gsl/gsl_math.h>
 #include <gsl/gsl_multiroots.h>
 
-#include "kurtic.h"
+#include "kernels.h"
+#include "quadrature.h"
 #include "vector.h"
 #include "solver.h"
+#include "output.h"
+#include "excess.h"
+#include "surface.h"
 
 typedef int (*func)(void);                 /* type of test function */
 
@@ -163,41 +168,671 @@ int test_norm()
 
 
 /*
- * Tests solver
+ * Prepares params to evaluate kernel moments by the quadrature rule: the
+ * residuals are the excess kurtosis and dispersion themselves
+ */
+void init_params(struct params *p, const struct quadrature *q)
+{
+    p->k = 0.0;
+    p->d = 0.0;
+    p->grid.count = q->count;
+    p->space_dim = 1;
+    p->accuracy = VM_FULL;
+    p->quad = q;
+    p->prefetch = 0;
+    clear_cache(p);
+}
+
+
+
+/*
+ * Tests quadrature rules: values and jacobians of the Roughgarden kernel
+ * moments must match the closed-form ones
+ */
+int test_quadrature()
+{
+    const char rules[] = "shktre";
+    const double points[2][2] = { { 1.0, 2.0 }, { 0.7, 3.0 } };
+    struct quadrature *exact = quad_alloc(QUAD_EXACT, 100001, 1e-10);
+    struct quadrature *q;
+    struct params p;
+    gsl_vector *x = gsl_vector_alloc(2);
+    gsl_vector *f = gsl_vector_alloc(2);
+    gsl_vector *fe = gsl_vector_alloc(2);
+    gsl_matrix *J = gsl_matrix_alloc(2, 2);
+    gsl_matrix *Je = gsl_matrix_alloc(2, 2);
+    double eps = 1e-6;
+    int flag = 1;
+    int i;
+    int j;
+    int m;
+
+    for(i = 0; rules[i] != '\0' && flag; i++){
+        q = quad_alloc(rules[i], 100001, 1e-10);
+        flag = assert_bool(q != NULL, "Rule allocation");
+
+        for(j = 0; j < 2 && flag; j++){
+            gsl_vector_set(x, 0, points[j][0]);
+            gsl_vector_set(x, 1, points[j][1]);
+
+            init_params(&p, exact);
+            rgarden_fdf(x, &p, fe, Je);
+            init_params(&p, q);
+            flag = assert_int(GSL_SUCCESS, rgarden_fdf(x, &p, f, J),
+                "Status");
+
+            for(m = 0; m < 4 && flag; m++){
+                flag = m < 2
+                    ? assert_double(gsl_vector_get(fe, m),
+                        gsl_vector_get(f, m), eps, "Value")
+                    : 1;
+                flag = flag && assert_double(
+                    gsl_matrix_get(Je, m / 2, m % 2),
+                    gsl_matrix_get(J, m / 2, m % 2),
+                    eps * fmax(1.0, fabs(gsl_matrix_get(Je, m / 2, m % 2))),
+                    "Jacobian");
+            }
+        }
+
+        if(!flag){
+            printf("    Rule: %c\n", rules[i]);
+        }
+        quad_free(q);
+    }
+
+    gsl_vector_free(x);
+    gsl_vector_free(f);
+    gsl_vector_free(fe);
+    gsl_matrix_free(J);
+    gsl_matrix_free(Je);
+    quad_free(exact);
+
+    return flag ? passed : failed;
+}
+
+
+
+/*
+ * Integrand of the cancellation test: x exp(-x^2) and exp(-x^2)
+ */
+void odd_values(const double *x, int n, double *f, void *ctx)
+{
+    int i;
+
+    for(i = 0; i < n; i++){
+        f[n + i] = exp(-x[i] * x[i]);
+        f[i] = x[i] * f[n + i];
+    }
+}
+
+
+
+/*
+ * Tests the reduced accuracy tiers: they must fall back to the full one
+ * for a tight eps, and single precision kernels must keep the moments
+ * within the bound that get_accuracy relies on
+ */
+int test_single_tier()
+{
+    const char kerns[] = "krp";
+    const FFunc funcs[] = { kurtic_f, rgarden_f, polyexp_f };
+    const double points[2][2] = { { 1.0, 2.0 }, { 0.7, 3.0 } };
+    struct quadrature *q = quad_alloc(QUAD_SIMPSON, 10001, 0.0);
+    struct problem_info pinf;
+    struct params p;
+    gsl_vector *x = gsl_vector_alloc(2);
+    gsl_vector *ff = gsl_vector_alloc(2);
+    gsl_vector *fs = gsl_vector_alloc(2);
+    double e;
+    double k;
+    double d;
+    int flag = 1;
+    int i;
+    int j;
+
+    pinf.k_grid.origin = 0.0;
+    pinf.k_grid.step = 0.5;
+    pinf.k_grid.count = 7;
+    pinf.d_grid.origin = 0.2;
+    pinf.d_grid.step = 0.1;
+    pinf.d_grid.count = 14;
+    pinf.row_first = 0;
+    pinf.row_stride = 1;
+    pinf.kern_type = RGARDEN;
+
+    pinf.accuracy = VM_SINGLE;
+    pinf.eps = 1e-12;
+    flag = assert_int(VM_FULL, get_accuracy(&pinf), "Tight single tier");
+    pinf.accuracy = VM_FAST;
+    flag = flag &&
+        assert_int(VM_FULL, get_accuracy(&pinf), "Tight fast tier");
+    pinf.accuracy = VM_SINGLE;
+    pinf.eps = 1e-3;
+    flag = flag &&
+        assert_int(VM_SINGLE, get_accuracy(&pinf), "Loose single tier");
+
+    for(i = 0; kerns[i] != '\0' && flag; i++){
+        e = get_kernel_error(get_kernel(kerns[i]), VM_SINGLE);
+
+        for(j = 0; j < 2 && flag; j++){
+            gsl_vector_set(x, 0, points[j][0]);
+            gsl_vector_set(x, 1, points[j][1]);
+            init_params(&p, q);
+            flag = assert_int(GSL_SUCCESS, funcs[i](x, &p, ff), "Full");
+            init_params(&p, q);
+            p.accuracy = VM_SINGLE;
+            flag = flag &&
+                assert_int(GSL_SUCCESS, funcs[i](x, &p, fs), "Single");
+
+            /* the bound of get_accuracy at the full tier moments */
+            k = gsl_vector_get(ff, 0);
+            d = gsl_vector_get(ff, 1);
+            flag = flag &&
+                assert_double(k, gsl_vector_get(fs, 0),
+                    4 * e / (1 - e) / (1 - e) * (fabs(k) + 3), "Kurtosis") &&
+                assert_double(d, gsl_vector_get(fs, 1),
+                    2 * e / (1 - e) * d * d, "Dispersion");
+        }
+
+        if(!flag){
+            printf("    Kernel: %c\n", kerns[i]);
+        }
+    }
+
+    gsl_vector_free(x);
+    gsl_vector_free(ff);
+    gsl_vector_free(fs);
+    quad_free(q);
+
+    return flag ? passed : failed;
+}
+
+
+
+/*
+ * Tests adaptive rules at a solver precision below the rounding of the
+ * moments: the tolerance must be raised, so the rules still converge
+ */
+int test_tight_eps()
+{
+    const char rules[] = "hktr";
+    struct excess_options o;
+    struct excess_context *ctx;
+    double a;
+    double b;
+    int flag = 1;
+    int i;
+
+    for(i = 0; rules[i] != '\0' && flag; i++){
+        excess_default_options(&o, RGARDEN);
+        o.quadrature = rules[i];
+        o.space_count = 100001;
+        o.eps = 1e-14;
+        ctx = excess_alloc(&o);
+        flag = assert_bool(ctx != NULL, "Context allocation") &&
+            assert_int(GSL_SUCCESS, excess_solve(ctx, 1.0, 0.5, &a, &b),
+                "Status");
+
+        if(!flag){
+            printf("    Rule: %c\n", rules[i]);
+        }
+        excess_free(ctx);
+    }
+
+    return flag ? passed : failed;
+}
+
+
+
+/*
+ * Tests that adaptive rules converge on an integral cancelling to zero
+ */
+int test_cancellation()
+{
+    const char rules[] = "hktr";
+    struct quadrature *q;
+    double res[2];
+    double err[2];
+    double eps = 1e-9;
+    int flag = 1;
+    int i;
+
+    for(i = 0; rules[i] != '\0' && flag; i++){
+        q = quad_alloc(rules[i], 100001, 1e-10);
+        flag =
+            assert_bool(quad_integrate(q, &odd_values, NULL, 2, 6.0, 0,
+                res, err) > 0, "Convergence") &&
+            assert_double(0.0, res[0], eps, "Odd integral") &&
+            assert_double(sqrt(M_PI), res[1], eps, "Even integral") &&
+            assert_double(0.0, err[0], eps, "Odd error estimate") &&
+            assert_double(0.0, err[1], eps, "Even error estimate");
+
+        if(!flag){
+            printf("    Rule: %c\n", rules[i]);
+        }
+        quad_free(q);
+    }
+
+    return flag ? passed : failed;
+}
+
+
+
+/*
+ * Integrand that no rule resolves within its node count: cos(400 x)
+ */
+void wave_values(const double *x, int n, double *f, void *ctx)
+{
+    int i;
+
+    for(i = 0; i < n; i++){
+        f[i] = cos(400 * x[i]);
+    }
+}
+
+
+
+/*
+ * Tests the Romberg rule at small node counts: the first grid must be
+ * made coarser, so levels run and estimate the error. Integrals that do
+ * not converge within the node count must be passed to the Gauss-Kronrod
+ * rule, and the count must be negated if it does not converge either
+ */
+int test_romberg()
+{
+    struct quadrature *q;
+    double res[2];
+    double err[2];
+    double eps = 1e-9;
+    int count;
+    int flag;
+
+    q = quad_alloc(QUAD_ROMBERG, 65, 1e-2);
+    count = quad_integrate(q, &odd_values, NULL, 2, 6.0, 0, res, err);
+    flag =
+        assert_int(65, count, "Count") &&
+        assert_bool(fabs(res[1] - sqrt(M_PI)) <= err[1], "Error estimate");
+
+    quad_free(q);
+    q = quad_alloc(QUAD_ROMBERG, 33, 1e-10);
+    count = quad_integrate(q, &odd_values, NULL, 2, 6.0, 0, res, err);
+    flag = flag &&
+        assert_bool(count > 33, "Fallback count") &&
+        assert_double(sqrt(M_PI), res[1], eps, "Fallback integral") &&
+        assert_double(0.0, err[1], eps, "Fallback error estimate");
+
+    count = quad_integrate(q, &wave_values, NULL, 1, 6.0, 0, res, err);
+    flag = flag && assert_bool(count < 0, "Non-convergence");
+    quad_free(q);
+
+    return flag ? passed : failed;
+}
+
+
+
+/*
+ * Tests solver: the solution must reproduce the target moments, that are
+ * checked by the closed-form moments of the Roughgarden kernel
  */
 int test_solver()
 {
     int flag;
     struct problem_info pinf;
     struct result res;
+    double k;
+    double d;
     double eps = 1e-5;
 
-    pinf.k_grid.origin = 0.0;
+    pinf.k_grid.origin = 1.0;
     pinf.k_grid.step = 0.0;
     pinf.k_grid.count = 1;
+    pinf.row_first = 0;
+    pinf.row_stride = 1;
 
     pinf.d_grid.origin = M_PI;
     pinf.d_grid.step = 0.0;
     pinf.d_grid.count = 1;
 
-    pinf.space_grid.origin = -30.0;
     pinf.space_grid.count = 100001;
-    pinf.space_grid.step =
-        (30.0 - pinf.space_grid.origin) / (pinf.space_grid.count - 1);
-
+    pinf.space_dim = 1;
     pinf.iter_count = 100;
     pinf.eps = 1e-9;
+    pinf.thread_count = 1;
+    pinf.continuation = 0;
+
+    pinf.kern_type = RGARDEN;
+    pinf.accuracy = VM_FULL;
+    pinf.quad = quad_alloc(QUAD_SIMPSON, pinf.space_grid.count, 0.0);
+    pinf.table = NULL;
+    pinf.polish = 0;
+    pinf.telemetry = NULL;
+    pinf.f = rgarden_f;
+    pinf.df = rgarden_df;
+    pinf.fdf = rgarden_fdf;
+
+    res = solve(&pinf);
+
+    flag =
+        assert_int(1, res.a.grid.count, "A count") &&
+        assert_int(1, res.b.grid.count, "B count") &&
+        assert_int(GSL_SUCCESS, get_exact_values(get_kernel(RGARDEN),
+            res.a.storage[0], res.b.storage[0], 1, &k, &d), "Exact moments") &&
+        assert_double(1.0, k, eps, "k") &&
+        assert_double(M_PI * M_PI, d, eps, "d");
+
+    quad_free(pinf.quad);
+    free(res.a.storage);
+    free(res.b.storage);
+
+    return flag ? passed : failed;
+}
+
+
+
+
+
+/*
+ * Tests the library context: batches must get the statuses and the
+ * solutions of single queries for every kernel, including a target with
+ * two close roots
+ */
+int test_context()
+{
+    const char kerns[] = "krp";
+    const double k[6] = { 0.0, 1.0, -0.5, 1.083, 2.5, -0.5 };
+    const double d[6] = { 0.5, 0.8, 0.3, 0.2, 1.2, 0.5 };
+    struct excess_options o;
+    struct excess_context *ctx;
+    double a[6];
+    double b[6];
+    int status[6];
+    double single_a;
+    double single_b;
+    int single;
+    int unsolved;
+    int flag = 1;
+    int i;
+    int j;
+
+    for(i = 0; kerns[i] != '\0' && flag; i++){
+        excess_default_options(&o, kerns[i]);
+        ctx = excess_alloc(&o);
+        if(!assert_bool(ctx != NULL, "Context allocation")){
+            return failed;
+        }
+
+        unsolved = excess_solve_batch(ctx, 6, k, d, a, b, status);
+
+        for(j = 0; j < 6 && flag; j++){
+            single = excess_solve(ctx, k[j], d[j], &single_a, &single_b);
+            unsolved -= single != GSL_SUCCESS;
+            flag = assert_int(single, status[j], "Status");
+            if(flag && single == GSL_SUCCESS){
+                flag =
+                    assert_double(single_a, a[j],
+                        1e-9 * fmax(1.0, fabs(single_a)), "a") &&
+                    assert_double(single_b, b[j],
+                        1e-9 * fmax(1.0, fabs(single_b)), "b");
+            }
+
+            if(!flag){
+                printf("    Target: k = %lf, d = %lf\n", k[j], d[j]);
+            }
+        }
+
+        flag = flag && assert_int(0, unsolved, "Unsolved count");
+        if(!flag){
+            printf("    Kernel: %c\n", kerns[i]);
+        }
+
+        excess_free(ctx);
+    }
+
+    return flag ? passed : failed;
+}
+
+
+
+
+
+/*
+ * Tests a target whose jacobian is singular at the begin solution: the
+ * library must return the GSL error status instead of aborting
+ */
+int test_singular()
+{
+    int flag;
+    struct excess_options o;
+    struct excess_context *ctx;
+    double a;
+    double b;
+
+    excess_default_options(&o, RGARDEN);
+    ctx = excess_alloc(&o);
+    if(!assert_bool(ctx != NULL, "Context allocation")){
+        return failed;
+    }
+
+    flag = assert_int(GSL_EDOM, excess_solve(ctx, -2.0, 0.1, &a, &b),
+        "Status");
+
+    excess_free(ctx);
+
+    return flag ? passed : failed;
+}
 
-    res = solve(pinf);
+
+
+/*
+ * Tests radial moments: a solution in two dimensions must have the given
+ * excess and dispersion of a coordinate by the closed-form moments
+ */
+int test_radial()
+{
+    int flag;
+    struct excess_options o;
+    struct excess_context *ctx;
+    double a;
+    double b;
+    double k;
+    double d;
+    double eps = 1e-5;
+
+    excess_default_options(&o, RGARDEN);
+    o.space_count = 100001;
+    o.space_dim = 2;
+    o.eps = 1e-9;
+    ctx = excess_alloc(&o);
+    if(!assert_bool(ctx != NULL, "Context allocation")){
+        return failed;
+    }
 
     flag =
-        assert_int(res.s0.grid.count, 1, "S0 count") &&
-        assert_int(res.s1.grid.count, 1, "S1 count") &&
-        assert_double(1.0 / M_PI / M_PI, res.s0.storage[0], eps, "s0") &&
-        assert_double(1.0 / M_PI / M_PI, res.s1.storage[0], eps,"s1");
+        assert_int(GSL_SUCCESS, excess_solve(ctx, 1.0, 0.5, &a, &b),
+            "Status") &&
+        assert_int(GSL_SUCCESS, get_exact_values(get_kernel(RGARDEN), a, b,
+            2, &k, &d), "Exact moments") &&
+        assert_double(1.0, k, eps, "k") &&
+        assert_double(0.25, d, eps, "d");
+
+    excess_free(ctx);
+
+    return flag ? passed : failed;
+}
+
+
+
+
+/*
+ * Makes the problem of the output tests: 4 excess rows of 3 points
+ */
+void make_output_problem(struct problem_info *p)
+{
+    p->k_grid.origin = -1.0;
+    p->k_grid.step = 0.5;
+    p->k_grid.count = 4;
+    p->row_first = 0;
+    p->row_stride = 1;
+
+    p->d_grid.origin = 0.2;
+    p->d_grid.step = 0.1;
+    p->d_grid.count = 3;
+
+    p->space_grid.count = 11;
+    p->space_dim = 1;
+    p->eps = 1e-6;
+    p->kern_type = RGARDEN;
+    p->quad = quad_alloc(QUAD_SIMPSON, p->space_grid.count, 0.0);
+}
+
+
+
+/*
+ * Writes the rows [first, last) to the result file one by one, the rows
+ * from the bad one on get wrong values. Returns 1 if the file is not
+ * resumed from the first row
+ */
+int write_rows(const char *name, const struct problem_info *p, int binary,
+    int first, int last, int bad)
+{
+    struct writer w;
+    struct result res;
+    double a[3];
+    double b[3];
+    int status;
+    int row;
+    int j;
+
+    res.a.storage = a;
+    res.b.storage = b;
+
+    if(writer_open(&w, name, p, binary, 1) != 0){
+        return 1;
+    }
+
+    status = w.next_row != first;
+    for(row = first; row < last && status == 0; row++){
+        for(j = 0; j < p->d_grid.count; j++){
+            a[j] = 10 * row + j + (row >= bad ? 100 : 0);
+            b[j] = -a[j];
+        }
+        status = writer_put(&w, &res, 1);
+    }
+
+    return writer_close(&w) != 0 || status != 0;
+}
+
+
+
+/*
+ * Tears the last line of the file, as an interrupted write does
+ */
+void tear_last_line(const char *name)
+{
+    FILE *f = fopen(name, "r+");
+
+    if(f != NULL){
+        fseek(f, 0, SEEK_END);
+        ftruncate(fileno(f), ftell(f) - 2);
+        fclose(f);
+    }
+}
+
+
+
+/*
+ * Checks whether the files have the same contents
+ */
+int is_same_file(const char *x, const char *y)
+{
+    FILE *fx = fopen(x, "rb");
+    FILE *fy = fopen(y, "rb");
+    int cx = 0;
+    int cy = 0;
+
+    while(fx != NULL && fy != NULL && cx == cy && cx != EOF){
+        cx = fgetc(fx);
+        cy = fgetc(fy);
+    }
+
+    if(fx != NULL){
+        fclose(fx);
+    }
+    if(fy != NULL){
+        fclose(fy);
+    }
+
+    return fx != NULL && fy != NULL && cx == cy;
+}
 
-    free(res.s0.storage);
-    free(res.s1.storage);
+
+
+/*
+ * Tests the checkpoint journal in the text and the binary formats: a
+ * sweep interrupted in a chunk resumes from its last checkpoint into the
+ * same file as the sweep written at once, and a journal of another sweep
+ * or of another format is not resumed
+ */
+int test_journal()
+{
+    const char *names[2][2] = {
+        { "test_text.out", "test_text.ref" },
+        { "test_binary.out", "test_binary.ref" }
+    };
+    struct problem_info p;
+    struct problem_info other;
+    char *journal;
+    int flag = 1;
+    int binary;
+    int i;
+
+    make_output_problem(&p);
+    other = p;
+    other.eps = 1e-7;
+
+    for(binary = 0; binary < 2 && flag; binary++){
+        for(i = 0; i < 2; i++){
+            journal = get_journal_name(names[binary][i]);
+            remove(journal);
+            free(journal);
+        }
+
+        journal = get_journal_name(names[binary][0]);
+        flag =
+            assert_int(0, write_rows(names[binary][1], &p, binary, 0, 4, 4),
+                "Sweep") &&
+            assert_int(0, write_rows(names[binary][0], &p, binary, 0, 3, 2),
+                "Interrupted sweep");
+
+        /* the checkpoint of the bad row is torn */
+        tear_last_line(journal);
+
+        flag = flag &&
+            assert_int(0, write_rows(names[binary][0], &p, binary, 2, 4, 4),
+                "Resumed sweep") &&
+            assert_bool(is_same_file(names[binary][0], names[binary][1]),
+                "Resumed file") &&
+            assert_int(1, write_rows(names[binary][0], &other, binary, 4, 4,
+                4), "Other sweep") &&
+            assert_int(1, write_rows(names[binary][0], &p, !binary, 4, 4, 4),
+                "Other format") &&
+            assert_bool(is_same_file(names[binary][0], names[binary][1]),
+                "Rejected file");
+
+        if(!flag){
+            printf("    Binary: %d\n", binary);
+        }
+
+        remove(journal);
+        free(journal);
+        journal = get_journal_name(names[binary][1]);
+        remove(journal);
+        free(journal);
+        remove(names[binary][0]);
+        remove(names[binary][1]);
+    }
+
+    quad_free(p.quad);
 
     return flag ? passed : failed;
 }
@@ -205,6 +840,238 @@ int test_solver()
 
 
 
+/*
+ * Solves the given count of rows of the shard into its file, with the
+ * journal as the excess program does. Returns 0 on success
+ */
+int solve_shard(struct problem_info *p, int index, int count, int binary,
+    const char *file_name, int rows)
+{
+    struct problem_info shard;
+    struct writer w;
+    struct result res;
+    char *name = get_shard_name(file_name, index);
+    char *journal = get_journal_name(name);
+    int status;
+
+    get_shard_problem(p, index, count, get_accuracy(p), &shard);
+    remove(journal);
+
+    status = writer_open(&w, name, &shard, binary, 1);
+    if(status == 0){
+        init_result_info(&res, &shard, rows);
+        solve_rows(&shard, 0, rows, &res);
+        status = writer_put(&w, &res, rows);
+        status = writer_close(&w) != 0 || status != 0;
+        free(res.a.storage);
+        free(res.b.storage);
+    }
+
+    free(journal);
+    free(name);
+
+    return status;
+}
+
+
+
+/*
+ * Removes the result file with its journal
+ */
+void remove_result(const char *file_name)
+{
+    char *journal = get_journal_name(file_name);
+
+    remove(journal);
+    remove(file_name);
+    free(journal);
+}
+
+
+
+/*
+ * Tests sharded sweeps in the text and the binary formats: merged shards
+ * must be the same bytes as the sweep solved at once, and a merge with an
+ * incomplete shard must fail
+ */
+int test_shards()
+{
+    const char *merged = "test_merge.out";
+    const char *single = "test_merge.ref";
+    struct problem_info p;
+    struct writer w;
+    struct result res;
+    char *name;
+    int flag = 1;
+    int binary;
+    int i;
+
+    p.k_grid.origin = 0.5;
+    p.k_grid.step = 0.5 / 6;
+    p.k_grid.count = 7;
+    p.row_first = 0;
+    p.row_stride = 1;
+
+    p.d_grid.origin = 0.5;
+    p.d_grid.step = 0.5 / 4;
+    p.d_grid.count = 5;
+
+    p.space_grid.count = 10001;
+    p.space_dim = 1;
+    p.iter_count = 100;
+    p.eps = 1e-6;
+    p.thread_count = 1;
+    p.continuation = 0;
+    p.accuracy = VM_FULL;
+    p.quad = quad_alloc(QUAD_SIMPSON, p.space_grid.count, 0.0);
+    p.table = NULL;
+    p.polish = 0;
+    p.telemetry = NULL;
+    set_kernel(&p, KURTIC);
+
+    for(binary = 0; binary < 2 && flag; binary++){
+        res = solve(&p);
+        flag =
+            assert_int(0, writer_open(&w, single, &p, binary, 0), "Open") &&
+            assert_int(0, writer_put(&w, &res, p.k_grid.count), "Sweep");
+        writer_close(&w);
+        free(res.a.storage);
+        free(res.b.storage);
+
+        flag = flag &&
+            assert_int(0, solve_shard(&p, 0, 2, binary, merged, 4),
+                "Shard 0") &&
+            assert_int(0, solve_shard(&p, 1, 2, binary, merged, 3),
+                "Shard 1") &&
+            assert_int(0, merge_shards(&p, 2, binary, merged), "Merge") &&
+            assert_bool(is_same_file(merged, single), "Merged file") &&
+            assert_int(0, solve_shard(&p, 1, 2, binary, merged, 2),
+                "Incomplete shard 1") &&
+            assert_int(2, merge_shards(&p, 2, binary, merged),
+                "Incomplete merge");
+
+        /* a shard solved with another accuracy tier is not merged */
+        p.accuracy = VM_FAST;
+        flag = flag &&
+            assert_int(0, solve_shard(&p, 1, 2, binary, merged, 3),
+                "Fast shard 1");
+        p.accuracy = VM_FULL;
+        flag = flag &&
+            assert_int(2, merge_shards(&p, 2, binary, merged),
+                "Merge of another tier");
+
+        if(!flag){
+            printf("    Binary: %d\n", binary);
+        }
+
+        for(i = 0; i < 2; i++){
+            name = get_shard_name(merged, i);
+            remove_result(name);
+            free(name);
+        }
+        remove_result(merged);
+        remove_result(single);
+    }
+
+    quad_free(p.quad);
+
+    return flag ? passed : failed;
+}
+
+
+
+
+/*
+ * Pair solver of the surface test: fails for negative s0m, otherwise
+ * the density is s0m
+ */
+double test_pair_solver(const double *k, const struct surface_model *m,
+    void *ctx)
+{
+    return k[0] < 0 ? NAN : k[0];
+}
+
+
+
+/*
+ * Solves the pair table by the solver and checks the surface rows against
+ * the expected relative densities. Empty lines of the table must be kept
+ */
+int check_surface(PairSolver solver, const double *expected,
+    long expected_failed)
+{
+    static const char *table =
+        "0.1 0.2 0.3 0.4 5.0 0.0 1.0 0.0\n"
+        "\n"
+        "2.1 2.2 2.3 2.4 -1.0 0.0 1.0 0.0\n"
+        "3.1 3.2 3.3 3.4 7.5 0.0 1.0 0.0\n";
+    struct surface_info info;
+    char line[128];
+    double v[5];
+    FILE *in = tmpfile();
+    FILE *out = tmpfile();
+    long failed;
+    int flag;
+    int row = 0;
+
+    info.solver = solver;
+    info.ctx = NULL;
+    info.model.b = 1.0;
+    info.model.d = 0.0;
+    info.model.s = 0.4;
+    info.model.dim = 1;
+    info.thread_count = 2;
+
+    fputs(table, in);
+    rewind(in);
+
+    flag =
+        assert_int(0, solve_surface(in, out, &info, &failed), "Status") &&
+        assert_int(expected_failed, failed, "Failed points");
+
+    rewind(out);
+    while(flag && fgets(line, sizeof(line), out) != NULL){
+        if(row == 1){
+            flag = assert_bool(line[0] == '\n', "Empty line");
+        }else{
+            flag =
+                assert_int(5, sscanf(line, "%lf %lf %lf %lf %lf", v, v + 1,
+                    v + 2, v + 3, v + 4), "Row") &&
+                assert_double(row + 0.1, v[0], 1e-9, "km") &&
+                assert_double(row + 0.4, v[3], 1e-9, "dw") &&
+                assert_double(expected[row], v[4], 1e-6, "Relative N");
+        }
+        row++;
+    }
+
+    fclose(in);
+    fclose(out);
+
+    return flag && assert_int(4, row, "Row count");
+}
+
+
+
+/*
+ * Tests the surface driver: the stub solver gives the mean-field density
+ * N / Nmf = 1, failed points get SURFACE_NAN_VALUE / Nmf
+ */
+int test_surface()
+{
+    const double meanfield = 2.5;
+    const double stub[4] = { 1.0, 0.0, 1.0, 1.0 };
+    const double solved[4] = {
+        5.0 / meanfield, 0.0, SURFACE_NAN_VALUE / meanfield, 3.0
+    };
+
+    return check_surface(&stub_pair_solver, stub, 0) &&
+        check_surface(&test_pair_solver, solved, 1)
+        ? passed
+        : failed;
+}
+
+
+
 
 /*======================================================================*/
 /*                                   MAIN                               */
@@ -217,18 +1084,31 @@ int main(int argc, const char **argv)
     struct func_info test_funcs[] = {
         { &test_integral, "test_integral" },
         { &test_norm, "test_norm" },
-        { &test_solver, "test_solver" }
+        { &test_quadrature, "test_quadrature" },
+        { &test_cancellation, "test_cancellation" },
+        { &test_romberg, "test_romberg" },
+        { &test_tight_eps, "test_tight_eps" },
+        { &test_single_tier, "test_single_tier" },
+        { &test_solver, "test_solver" },
+        { &test_context, "test_context" },
+        { &test_singular, "test_singular" },
+        { &test_radial, "test_radial" },
+        { &test_journal, "test_journal" },
+        { &test_shards, "test_shards" },
+        { &test_surface, "test_surface" }
     };
 
     unsigned int i;
+    int status = 0;
     for(i = 0; i < sizeof(test_funcs) / sizeof(struct func_info); i++){
         printf("%s: ", test_funcs[i].name);
         if(test_funcs[i].function() == passed){
             printf("passed\n");
         }else{
             printf("FAILED!\n\n");
+            status = 1;
         }
     }
 
-    return 0;
+    return status;
 }
@@ -1,41 +1,74 @@
 #include "vector.h"
 
+
+
 /*
- * Weight in a quadratic integrate formula
+ * Count of values summed plainly before the compensated addition
  */
-inline static double weight(int i, int n, double step)
+#define SUM_GROUP 16
+
+
+
+/*
+ * Sums every second value from beg up to end, or their absolute values.
+ * Groups of SUM_GROUP values are summed into two partial sums, so
+ * additions do not wait for each other, and group sums are accumulated
+ * with compensation, so the rounding error does not grow with the count
+ * of values
+ */
+static double sum_alternate(const double *v, int beg, int end, int absolute)
 {
-    double s = step / 3;
+    double sum = 0.0;
+    double comp = 0.0;
+    double s0;
+    double s1;
+    int last;
+    int g;
+    int i;
+
+    for(g = beg; g < end; g += 2 * SUM_GROUP){
+        last = end - g < 2 * SUM_GROUP ? end : g + 2 * SUM_GROUP;
+        s0 = s1 = 0.0;
+        for(i = g; i + 2 < last; i += 4){
+            s0 += absolute ? fabs(v[i]) : v[i];
+            s1 += absolute ? fabs(v[i + 2]) : v[i + 2];
+        }
+        for(; i < last; i += 2){
+            s0 += absolute ? fabs(v[i]) : v[i];
+        }
+        add_compensated(&sum, &comp, s0 + s1);
+    }
 
-    return
-        i == 0 || i == n - 1 ? s :
-        i % 2 == 1 ? 4 * s : 2 * s;
+    return sum - comp;
 }
 
 
 
+/*
+ * Simpson's rule: the end nodes have the weight step / 3, odd inner nodes
+ * 4 step / 3 and even inner nodes 2 step / 3. The classes are summed apart,
+ * so the loops have no branches
+ */
 double get_norm(const struct vector_func *f)
 {
-    int i;
-    double res = 0.0;
+    const double *v = f->storage;
+    int n = f->grid.count;
+    double odd = sum_alternate(v, 1, n - 1, 1);
+    double even = sum_alternate(v, 2, n - 1, 1);
 
-    for(i = 0; i < f->grid.count; i++){
-        res += fabs(f->storage[i]) * weight(i, f->grid.count, f->grid.step);
-    }
-
-    return res;
+    return f->grid.step / 3 *
+        (fabs(v[0]) + (n > 1 ? fabs(v[n - 1]) : 0.0) + 4 * odd + 2 * even);
 }
 
 
 
 double get_integral(const struct vector_func *f)
 {
-    int i;
-    double res = 0.0;
-
-    for(i = 0; i < f->grid.count; i++){
-        res += f->storage[i] * weight(i, f->grid.count, f->grid.step);
-    }
+    const double *v = f->storage;
+    int n = f->grid.count;
+    double odd = sum_alternate(v, 1, n - 1, 0);
+    double even = sum_alternate(v, 2, n - 1, 0);
 
-    return res;
+    return f->grid.step / 3 *
+        (v[0] + (n > 1 ? v[n - 1] : 0.0) + 4 * odd + 2 * even);
 }
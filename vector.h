@@ -25,6 +25,22 @@ struct vector_func{
 
 
 
+/*
+ * Adds the value to the sum with Kahan compensation: comp holds the lost
+ * low-order part, so the rounding error does not grow with the count of
+ * terms
+ */
+static inline void add_compensated(double *sum, double *comp, double x)
+{
+    double y = x - *comp;
+    double t = *sum + y;
+
+    *comp = (t - *sum) - y;
+    *sum = t;
+}
+
+
+
 /*
  * Calculates integral of given function
  */
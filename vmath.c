@@ -0,0 +1,632 @@
+#include <math.h>
+#include <immintrin.h>
+
+#include "vmath.h"
+
+/*
+ * Exponent is calculated as 2^n * P(r), where x = n * ln2 + r and
+ * |r| <= ln2 / 2. P is the Taylor polynomial, so the truncation error is
+ * bounded by (ln2 / 2)^(N + 1) / (N + 1)! * sqrt(2) for the degree N.
+ * Degree 13 leaves only the rounding error, degree 8 gives 2.8e-10
+ */
+#define EXP_FULL_DEGREE 13
+#define EXP_FAST_DEGREE 8
+#define EXP_FULL_ERROR 1e-15
+#define EXP_FAST_ERROR 3e-10
+
+/*
+ * Single tier: the reduction to r is made in double, so its error does not
+ * grow with |x|, and P(r) of degree 7 (truncation 7.3e-9) is evaluated in
+ * float32 at twice the vector width. Horner's scheme on |r| <= ln2 / 2
+ * adds at most 3 rounding errors of 2^-24 to the conversion of r and the
+ * result
+ */
+#define EXP_SINGLE_DEGREE 7
+#define EXP_SINGLE_ERROR 4e-7
+
+/*
+ * Arguments out of this range give zero and infinity. Results below the
+ * smallest normal number are flushed to zero
+ */
+#define EXP_MIN -708.0
+#define EXP_MAX 709.782712893384
+
+#define LOG2E 1.4426950408889634
+#define LN2_HI 6.93145751953125e-1
+#define LN2_LO 1.42860682030941723212e-6
+
+/*
+ * Logarithm is calculated as e * ln2 + 2 atanh(z), z = (m - 1) / (m + 1),
+ * where m is the mantissa reduced to [sqrt(2) / 2, sqrt(2)], so |z| is
+ * below 0.1716 and 11 odd terms of atanh series are enough
+ */
+#define LOG_TERMS 11
+
+typedef void (*Vector)(double *, int, int);
+typedef void (*VectorLog)(double *, int);
+
+/*
+ * Reciprocal factorials 1/k!, k = 0, ..., EXP_FULL_DEGREE
+ */
+static const double exp_coeffs[] = {
+    1.0,
+    1.0,
+    1.0 / 2,
+    1.0 / 6,
+    1.0 / 24,
+    1.0 / 120,
+    1.0 / 720,
+    1.0 / 5040,
+    1.0 / 40320,
+    1.0 / 362880,
+    1.0 / 3628800,
+    1.0 / 39916800,
+    1.0 / 479001600,
+    1.0 / 6227020800.0
+};
+
+/*
+ * Coefficients 1 / (2k + 1) of atanh(z) / z series in z^2
+ */
+static const double log_coeffs[] = {
+    1.0,
+    1.0 / 3,
+    1.0 / 5,
+    1.0 / 7,
+    1.0 / 9,
+    1.0 / 11,
+    1.0 / 13,
+    1.0 / 15,
+    1.0 / 17,
+    1.0 / 19,
+    1.0 / 21
+};
+
+
+
+/*=======================================================================*/
+/*                                 Scalar                                */
+/*=======================================================================*/
+static double exp_degree(int accuracy)
+{
+    return accuracy == VM_FAST ? EXP_FAST_DEGREE : EXP_FULL_DEGREE;
+}
+
+
+
+/*
+ * Scalar version of the shortened exponent
+ */
+static double fast_exp(double x)
+{
+    double n;
+    double r;
+    double p;
+    int i;
+
+    if(x < EXP_MIN){
+        return 0.0;
+    }
+
+    if(x > EXP_MAX){
+        return HUGE_VAL;
+    }
+
+    n = nearbyint(x * LOG2E);
+    r = x - n * LN2_HI - n * LN2_LO;
+
+    p = exp_coeffs[EXP_FAST_DEGREE];
+    for(i = EXP_FAST_DEGREE - 1; i >= 0; i--){
+        p = p * r + exp_coeffs[i];
+    }
+
+    return ldexp(p, (int)n);
+}
+
+
+
+/*
+ * Scalar version of the single precision exponent
+ */
+static double single_exp(double x)
+{
+    double n;
+    float r;
+    float p;
+    int i;
+
+    if(x < EXP_MIN){
+        return 0.0;
+    }
+
+    if(x > EXP_MAX){
+        return HUGE_VAL;
+    }
+
+    n = nearbyint(x * LOG2E);
+    r = (float)(x - n * LN2_HI - n * LN2_LO);
+
+    p = (float)exp_coeffs[EXP_SINGLE_DEGREE];
+    for(i = EXP_SINGLE_DEGREE - 1; i >= 0; i--){
+        p = p * r + (float)exp_coeffs[i];
+    }
+
+    return ldexp(p, (int)n);
+}
+
+
+
+static void scalar_exp(double *v, int n, int accuracy)
+{
+    int i;
+
+    if(accuracy == VM_FAST){
+        for(i = 0; i < n; i++){
+            v[i] = fast_exp(v[i]);
+        }
+    }else if(accuracy == VM_SINGLE){
+        for(i = 0; i < n; i++){
+            v[i] = single_exp(v[i]);
+        }
+    }else{
+        for(i = 0; i < n; i++){
+            v[i] = exp(v[i]);
+        }
+    }
+}
+
+
+
+static void scalar_log(double *v, int n)
+{
+    int i;
+
+    for(i = 0; i < n; i++){
+        v[i] = log(v[i]);
+    }
+}
+
+
+
+/*=======================================================================*/
+/*                                  AVX2                                 */
+/*=======================================================================*/
+/*
+ * Single tier: two double vectors are reduced, their r values are packed
+ * into one float32 vector for the polynomial, then scaled back in double
+ */
+__attribute__((target("avx2,fma")))
+static void avx2_exp_single(double *v, int n)
+{
+    __m256d log2e = _mm256_set1_pd(LOG2E);
+    __m256d ln2_hi = _mm256_set1_pd(LN2_HI);
+    __m256d ln2_lo = _mm256_set1_pd(LN2_LO);
+    __m256d lo = _mm256_set1_pd(EXP_MIN);
+    __m256d hi = _mm256_set1_pd(EXP_MAX);
+    __m256d inf = _mm256_set1_pd(HUGE_VAL);
+    __m256d zero = _mm256_setzero_pd();
+    __m256d two = _mm256_set1_pd(2.0);
+    __m256i bias = _mm256_set1_epi64x(1022);
+    __m256d x[2];
+    __m256d e[2];
+    __m128 rh[2];
+    __m256d c;
+    __m256d r;
+    __m256d q;
+    __m256 rf;
+    __m256 p;
+    __m256i m;
+    int i;
+    int j;
+    int k;
+
+    for(i = 0; i + 8 <= n; i += 8){
+        for(k = 0; k < 2; k++){
+            x[k] = _mm256_loadu_pd(v + i + 4 * k);
+            c = _mm256_min_pd(_mm256_max_pd(x[k], lo), hi);
+
+            e[k] = _mm256_round_pd(_mm256_mul_pd(c, log2e),
+                _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+            r = _mm256_fnmadd_pd(e[k], ln2_hi, c);
+            r = _mm256_fnmadd_pd(e[k], ln2_lo, r);
+            rh[k] = _mm256_cvtpd_ps(r);
+        }
+
+        rf = _mm256_insertf128_ps(_mm256_castps128_ps256(rh[0]), rh[1], 1);
+        p = _mm256_set1_ps((float)exp_coeffs[EXP_SINGLE_DEGREE]);
+        for(j = EXP_SINGLE_DEGREE - 1; j >= 0; j--){
+            p = _mm256_fmadd_ps(p, rf, _mm256_set1_ps((float)exp_coeffs[j]));
+        }
+
+        for(k = 0; k < 2; k++){
+            q = _mm256_cvtps_pd(k == 0
+                ? _mm256_castps256_ps128(p)
+                : _mm256_extractf128_ps(p, 1));
+
+            m = _mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(e[k]));
+            m = _mm256_slli_epi64(_mm256_add_epi64(m, bias), 52);
+            q = _mm256_mul_pd(_mm256_mul_pd(q, _mm256_castsi256_pd(m)), two);
+
+            q = _mm256_blendv_pd(q, zero,
+                _mm256_cmp_pd(x[k], lo, _CMP_LT_OQ));
+            q = _mm256_blendv_pd(q, inf,
+                _mm256_cmp_pd(x[k], hi, _CMP_GT_OQ));
+            q = _mm256_blendv_pd(q, x[k],
+                _mm256_cmp_pd(x[k], x[k], _CMP_UNORD_Q));
+
+            _mm256_storeu_pd(v + i + 4 * k, q);
+        }
+    }
+
+    scalar_exp(v + i, n - i, VM_SINGLE);
+}
+
+
+
+__attribute__((target("avx2,fma")))
+static void avx2_exp(double *v, int n, int accuracy)
+{
+    int deg = exp_degree(accuracy);
+    __m256d log2e = _mm256_set1_pd(LOG2E);
+    __m256d ln2_hi = _mm256_set1_pd(LN2_HI);
+    __m256d ln2_lo = _mm256_set1_pd(LN2_LO);
+    __m256d lo = _mm256_set1_pd(EXP_MIN);
+    __m256d hi = _mm256_set1_pd(EXP_MAX);
+    __m256d inf = _mm256_set1_pd(HUGE_VAL);
+    __m256d zero = _mm256_setzero_pd();
+    __m256d two = _mm256_set1_pd(2.0);
+    __m256i bias = _mm256_set1_epi64x(1022);
+    __m256d x;
+    __m256d c;
+    __m256d r;
+    __m256d p;
+    __m256d e;
+    __m256i m;
+    int i;
+    int j;
+
+    if(accuracy == VM_SINGLE){
+        avx2_exp_single(v, n);
+        return;
+    }
+
+    for(i = 0; i + 4 <= n; i += 4){
+        x = _mm256_loadu_pd(v + i);
+        c = _mm256_min_pd(_mm256_max_pd(x, lo), hi);
+
+        e = _mm256_round_pd(_mm256_mul_pd(c, log2e),
+            _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        r = _mm256_fnmadd_pd(e, ln2_hi, c);
+        r = _mm256_fnmadd_pd(e, ln2_lo, r);
+
+        p = _mm256_set1_pd(exp_coeffs[deg]);
+        for(j = deg - 1; j >= 0; j--){
+            p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(exp_coeffs[j]));
+        }
+
+        /* 2^n is built as 2^(n - 1) * 2 to keep n = 1024 finite */
+        m = _mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(e));
+        m = _mm256_slli_epi64(_mm256_add_epi64(m, bias), 52);
+        p = _mm256_mul_pd(_mm256_mul_pd(p, _mm256_castsi256_pd(m)), two);
+
+        p = _mm256_blendv_pd(p, zero, _mm256_cmp_pd(x, lo, _CMP_LT_OQ));
+        p = _mm256_blendv_pd(p, inf, _mm256_cmp_pd(x, hi, _CMP_GT_OQ));
+        p = _mm256_blendv_pd(p, x, _mm256_cmp_pd(x, x, _CMP_UNORD_Q));
+
+        _mm256_storeu_pd(v + i, p);
+    }
+
+    scalar_exp(v + i, n - i, accuracy);
+}
+
+
+
+__attribute__((target("avx2,fma")))
+static void avx2_log(double *v, int n)
+{
+    __m256d one = _mm256_set1_pd(1.0);
+    __m256d half = _mm256_set1_pd(0.5);
+    __m256d sqrt2 = _mm256_set1_pd(M_SQRT2);
+    __m256d ln2 = _mm256_set1_pd(M_LN2);
+    __m256d zero = _mm256_setzero_pd();
+    __m256d ninf = _mm256_set1_pd(-HUGE_VAL);
+    __m256d pinf = _mm256_set1_pd(HUGE_VAL);
+    __m256d nan = _mm256_set1_pd(NAN);
+    __m256i mant_mask = _mm256_set1_epi64x(0x000fffffffffffffLL);
+    __m256i one_bits = _mm256_set1_epi64x(0x3ff0000000000000LL);
+    __m256i magic_bits = _mm256_set1_epi64x(0x4330000000000000LL);
+    __m256d magic = _mm256_set1_pd(4503599627370496.0 + 1023.0);
+    __m256d tiny = _mm256_set1_pd(2.2250738585072014e-308);
+    __m256d scale = _mm256_set1_pd(4503599627370496.0);
+    __m256d shift = _mm256_set1_pd(52.0);
+    __m256d sub;
+    __m256d x;
+    __m256d m;
+    __m256d e;
+    __m256d z;
+    __m256d zz;
+    __m256d p;
+    __m256d big;
+    __m256i bits;
+    int i;
+    int j;
+
+    for(i = 0; i + 4 <= n; i += 4){
+        x = _mm256_loadu_pd(v + i);
+
+        /* subnormal numbers are scaled by 2^52 to get a mantissa */
+        sub = _mm256_cmp_pd(x, tiny, _CMP_LT_OQ);
+        bits = _mm256_castpd_si256(
+            _mm256_blendv_pd(x, _mm256_mul_pd(x, scale), sub));
+
+        e = _mm256_castsi256_pd(
+            _mm256_or_si256(_mm256_srli_epi64(bits, 52), magic_bits));
+        e = _mm256_sub_pd(e, magic);
+        e = _mm256_sub_pd(e, _mm256_and_pd(sub, shift));
+        m = _mm256_castsi256_pd(
+            _mm256_or_si256(_mm256_and_si256(bits, mant_mask), one_bits));
+
+        big = _mm256_cmp_pd(m, sqrt2, _CMP_GT_OQ);
+        m = _mm256_blendv_pd(m, _mm256_mul_pd(m, half), big);
+        e = _mm256_add_pd(e, _mm256_and_pd(big, one));
+
+        z = _mm256_div_pd(_mm256_sub_pd(m, one), _mm256_add_pd(m, one));
+        zz = _mm256_mul_pd(z, z);
+
+        p = _mm256_set1_pd(log_coeffs[LOG_TERMS - 1]);
+        for(j = LOG_TERMS - 2; j >= 0; j--){
+            p = _mm256_fmadd_pd(p, zz, _mm256_set1_pd(log_coeffs[j]));
+        }
+
+        p = _mm256_mul_pd(_mm256_add_pd(z, z), p);
+        p = _mm256_fmadd_pd(e, ln2, p);
+
+        p = _mm256_blendv_pd(p, ninf, _mm256_cmp_pd(x, zero, _CMP_EQ_OQ));
+        p = _mm256_blendv_pd(p, pinf, _mm256_cmp_pd(x, pinf, _CMP_EQ_OQ));
+        p = _mm256_blendv_pd(p, nan, _mm256_cmp_pd(x, zero, _CMP_NGE_UQ));
+
+        _mm256_storeu_pd(v + i, p);
+    }
+
+    scalar_log(v + i, n - i);
+}
+
+
+
+/*=======================================================================*/
+/*                                AVX-512                                */
+/*=======================================================================*/
+__attribute__((target("avx512f")))
+static void avx512_exp_single(double *v, int n)
+{
+    __m512d log2e = _mm512_set1_pd(LOG2E);
+    __m512d ln2_hi = _mm512_set1_pd(LN2_HI);
+    __m512d ln2_lo = _mm512_set1_pd(LN2_LO);
+    __m512d lo = _mm512_set1_pd(EXP_MIN);
+    __m512d hi = _mm512_set1_pd(EXP_MAX);
+    __m512d x[2];
+    __m512d e[2];
+    __m256 rh[2];
+    __m256 ph[2];
+    __m512d c;
+    __m512d r;
+    __m512d q;
+    __m512 rf;
+    __m512 p;
+    int i;
+    int j;
+    int k;
+
+    for(i = 0; i + 16 <= n; i += 16){
+        for(k = 0; k < 2; k++){
+            x[k] = _mm512_loadu_pd(v + i + 8 * k);
+            c = _mm512_min_pd(_mm512_max_pd(x[k], lo), hi);
+
+            e[k] = _mm512_roundscale_pd(_mm512_mul_pd(c, log2e),
+                _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+            r = _mm512_fnmadd_pd(e[k], ln2_hi, c);
+            r = _mm512_fnmadd_pd(e[k], ln2_lo, r);
+            rh[k] = _mm512_cvtpd_ps(r);
+        }
+
+        rf = _mm512_castpd_ps(_mm512_insertf64x4(
+            _mm512_castps_pd(_mm512_castps256_ps512(rh[0])),
+            _mm256_castps_pd(rh[1]), 1));
+        p = _mm512_set1_ps((float)exp_coeffs[EXP_SINGLE_DEGREE]);
+        for(j = EXP_SINGLE_DEGREE - 1; j >= 0; j--){
+            p = _mm512_fmadd_ps(p, rf, _mm512_set1_ps((float)exp_coeffs[j]));
+        }
+
+        /* the extract immediate must be a constant */
+        ph[0] = _mm512_castps512_ps256(p);
+        ph[1] = _mm256_castpd_ps(
+            _mm512_extractf64x4_pd(_mm512_castps_pd(p), 1));
+
+        for(k = 0; k < 2; k++){
+            q = _mm512_scalef_pd(_mm512_cvtps_pd(ph[k]), e[k]);
+
+            q = _mm512_mask_mov_pd(q,
+                _mm512_cmp_pd_mask(x[k], lo, _CMP_LT_OQ),
+                _mm512_setzero_pd());
+            q = _mm512_mask_mov_pd(q,
+                _mm512_cmp_pd_mask(x[k], hi, _CMP_GT_OQ),
+                _mm512_set1_pd(HUGE_VAL));
+            q = _mm512_mask_mov_pd(q,
+                _mm512_cmp_pd_mask(x[k], x[k], _CMP_UNORD_Q), x[k]);
+
+            _mm512_storeu_pd(v + i + 8 * k, q);
+        }
+    }
+
+    scalar_exp(v + i, n - i, VM_SINGLE);
+}
+
+
+
+__attribute__((target("avx512f")))
+static void avx512_exp(double *v, int n, int accuracy)
+{
+    int deg = exp_degree(accuracy);
+    __m512d log2e = _mm512_set1_pd(LOG2E);
+    __m512d ln2_hi = _mm512_set1_pd(LN2_HI);
+    __m512d ln2_lo = _mm512_set1_pd(LN2_LO);
+    __m512d lo = _mm512_set1_pd(EXP_MIN);
+    __m512d hi = _mm512_set1_pd(EXP_MAX);
+    __m512d x;
+    __m512d c;
+    __m512d r;
+    __m512d p;
+    __m512d e;
+    int i;
+    int j;
+
+    if(accuracy == VM_SINGLE){
+        avx512_exp_single(v, n);
+        return;
+    }
+
+    for(i = 0; i + 8 <= n; i += 8){
+        x = _mm512_loadu_pd(v + i);
+        c = _mm512_min_pd(_mm512_max_pd(x, lo), hi);
+
+        e = _mm512_roundscale_pd(_mm512_mul_pd(c, log2e),
+            _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        r = _mm512_fnmadd_pd(e, ln2_hi, c);
+        r = _mm512_fnmadd_pd(e, ln2_lo, r);
+
+        p = _mm512_set1_pd(exp_coeffs[deg]);
+        for(j = deg - 1; j >= 0; j--){
+            p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(exp_coeffs[j]));
+        }
+
+        p = _mm512_scalef_pd(p, e);
+
+        p = _mm512_mask_mov_pd(p,
+            _mm512_cmp_pd_mask(x, lo, _CMP_LT_OQ), _mm512_setzero_pd());
+        p = _mm512_mask_mov_pd(p,
+            _mm512_cmp_pd_mask(x, hi, _CMP_GT_OQ), _mm512_set1_pd(HUGE_VAL));
+        p = _mm512_mask_mov_pd(p, _mm512_cmp_pd_mask(x, x, _CMP_UNORD_Q), x);
+
+        _mm512_storeu_pd(v + i, p);
+    }
+
+    scalar_exp(v + i, n - i, accuracy);
+}
+
+
+
+__attribute__((target("avx512f")))
+static void avx512_log(double *v, int n)
+{
+    __m512d one = _mm512_set1_pd(1.0);
+    __m512d half = _mm512_set1_pd(0.5);
+    __m512d sqrt2 = _mm512_set1_pd(M_SQRT2);
+    __m512d ln2 = _mm512_set1_pd(M_LN2);
+    __m512d zero = _mm512_setzero_pd();
+    __m512d pinf = _mm512_set1_pd(HUGE_VAL);
+    __m512d x;
+    __m512d m;
+    __m512d e;
+    __m512d z;
+    __m512d zz;
+    __m512d p;
+    __mmask8 big;
+    int i;
+    int j;
+
+    for(i = 0; i + 8 <= n; i += 8){
+        x = _mm512_loadu_pd(v + i);
+        e = _mm512_getexp_pd(x);
+        m = _mm512_getmant_pd(x, _MM_MANT_NORM_1_2, _MM_MANT_SIGN_zero);
+
+        big = _mm512_cmp_pd_mask(m, sqrt2, _CMP_GT_OQ);
+        m = _mm512_mask_mul_pd(m, big, m, half);
+        e = _mm512_mask_add_pd(e, big, e, one);
+
+        z = _mm512_div_pd(_mm512_sub_pd(m, one), _mm512_add_pd(m, one));
+        zz = _mm512_mul_pd(z, z);
+
+        p = _mm512_set1_pd(log_coeffs[LOG_TERMS - 1]);
+        for(j = LOG_TERMS - 2; j >= 0; j--){
+            p = _mm512_fmadd_pd(p, zz, _mm512_set1_pd(log_coeffs[j]));
+        }
+
+        p = _mm512_mul_pd(_mm512_add_pd(z, z), p);
+        p = _mm512_fmadd_pd(e, ln2, p);
+
+        p = _mm512_mask_mov_pd(p, _mm512_cmp_pd_mask(x, zero, _CMP_EQ_OQ),
+            _mm512_set1_pd(-HUGE_VAL));
+        p = _mm512_mask_mov_pd(p, _mm512_cmp_pd_mask(x, pinf, _CMP_EQ_OQ),
+            pinf);
+        p = _mm512_mask_mov_pd(p, _mm512_cmp_pd_mask(x, zero, _CMP_NGE_UQ),
+            _mm512_set1_pd(NAN));
+
+        _mm512_storeu_pd(v + i, p);
+    }
+
+    scalar_log(v + i, n - i);
+}
+
+
+
+/*=======================================================================*/
+/*                                Dispatch                               */
+/*=======================================================================*/
+static Vector exp_impl = &scalar_exp;
+static VectorLog log_impl = &scalar_log;
+static const char *isa_name = "scalar";
+
+
+
+/*
+ * Chooses the widest instruction set supported by the processor
+ */
+__attribute__((constructor))
+static void vm_init(void)
+{
+    __builtin_cpu_init();
+
+    if(__builtin_cpu_supports("avx512f")){
+        exp_impl = &avx512_exp;
+        log_impl = &avx512_log;
+        isa_name = "avx512";
+    }else if(__builtin_cpu_supports("avx2") &&
+        __builtin_cpu_supports("fma"))
+    {
+        exp_impl = &avx2_exp;
+        log_impl = &avx2_log;
+        isa_name = "avx2";
+    }
+}
+
+
+
+void vm_exp(double *v, int n, int accuracy)
+{
+    exp_impl(v, n, accuracy);
+}
+
+
+
+void vm_log(double *v, int n)
+{
+    log_impl(v, n);
+}
+
+
+
+double vm_exp_error(int accuracy)
+{
+    if(accuracy == VM_FAST){
+        return EXP_FAST_ERROR;
+    }
+
+    return accuracy == VM_SINGLE ? EXP_SINGLE_ERROR : EXP_FULL_ERROR;
+}
+
+
+
+const char *vm_isa(void)
+{
+    return isa_name;
+}
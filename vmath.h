@@ -0,0 +1,34 @@
+#ifndef VMATH_MODULE_H
+#define VMATH_MODULE_H
+
+/*
+ * Accuracy tiers of the vector functions
+ */
+#define VM_FULL 0               /* full double precision */
+#define VM_FAST 1               /* shortened polynomials */
+#define VM_SINGLE 2             /* float32 polynomials at twice the width */
+
+
+
+/*
+ * Calculates exponent of every array element in place
+ */
+void vm_exp(double *v, int n, int accuracy);
+
+/*
+ * Calculates natural logarithm of every array element in place. The
+ * logarithm is always calculated with full precision
+ */
+void vm_log(double *v, int n);
+
+/*
+ * Returns the bound of the relative error of vm_exp for the given tier
+ */
+double vm_exp_error(int accuracy);
+
+/*
+ * Returns the name of the instruction set used by the vector functions
+ */
+const char *vm_isa(void);
+
+#endif